@@ -0,0 +1,123 @@
+-module(ehashids_bench).
+
+%% Throughput and latency benchmarks for the ehashids NIF.
+%%
+%% Run with:
+%%   rebar3 as bench compile
+%%   erl -noshell -pa _build/bench/lib/ehashids/ebin _build/bench/lib/ehashids/bench \
+%%       -eval 'ehashids_bench:run(), halt().'
+%%
+%% Each case varies one parameter from a base of one 32 bit number, the
+%% default alphabet and no minimum hash length. Every case runs with 1, half
+%% of and all the online schedulers worth of processes. Latencies are per call
+%% in nanoseconds.
+
+-export([run/0, run/1]).
+
+-define(INPUTS, 1024).
+-define(DEFAULT_ITERATIONS, 20000).
+-define(SALT, <<"bench salt">>).
+
+%% @doc Runs every benchmark with the default options.
+%% @end
+-spec run() -> ok.
+run() ->
+    run(#{}).
+
+%% @doc Runs the benchmarks.
+%% <p>Options are `iterations' (calls per process), `concurrency' (a list of
+%% process counts) and `ops' (a list of operations to run, all by default).
+%% </p>
+%% @end
+-spec run(Opts :: map()) -> ok.
+run(Opts) ->
+    Iterations = maps:get(iterations, Opts, ?DEFAULT_ITERATIONS),
+    Schedulers = erlang:system_info(schedulers_online),
+    Concurrency = maps:get(concurrency, Opts, lists:usort([1, max(1, Schedulers div 2), Schedulers])),
+    Ops = maps:get(ops, Opts, all),
+    io:format("~-14s ~-16s ~5s ~12s ~9s ~9s ~9s~n",
+              ["op", "case", "procs", "ops/s", "p50 ns", "p99 ns", "p999 ns"]),
+    lists:foreach(
+      fun({Op, Case, Inputs, Call}) ->
+              lists:foreach(
+                fun(Procs) -> report(Op, Case, Procs, measure(Inputs, Call, Procs, Iterations)) end,
+                Concurrency)
+      end,
+      [C || {Op, _, _, _} = C <- cases(), Ops =:= all orelse lists:member(Op, Ops)]).
+
+cases() ->
+    Base = #{numbers => 1,
+             magnitude => 32,
+             alphabet => ehashids:default_alphabet(),
+             min_hash_length => 0},
+    Variants = [{"base", Base},
+                {"numbers=4", Base#{numbers => 4}},
+                {"numbers=16", Base#{numbers => 16}},
+                {"magnitude=8", Base#{magnitude => 8}},
+                {"magnitude=64", Base#{magnitude => 64}},
+                {"alphabet=16", Base#{alphabet => <<"0123456789abcdef">>}},
+                {"alphabet=36", Base#{alphabet => <<"0123456789abcdefghijklmnopqrstuvwxyz">>}},
+                {"min_len=16", Base#{min_hash_length => 16}},
+                {"min_len=32", Base#{min_hash_length => 32}}],
+    lists:flatmap(fun variant_cases/1, Variants).
+
+variant_cases({Name, #{numbers := Count, magnitude := Magnitude,
+                       alphabet := Alphabet, min_hash_length := MinHashLen}}) ->
+    Ref = ehashids:new(?SALT, MinHashLen, Alphabet),
+    NumbersList = [[rand:uniform(1 bsl Magnitude) - 1 || _ <- lists:seq(1, Count)]
+                   || _ <- lists:seq(1, ?INPUTS)],
+    {ok, Ids} = ehashids:encode_many(Ref, NumbersList),
+    Codec = [{encode, Name, list_to_tuple(NumbersList), fun(Numbers) -> ehashids:encode(Ref, Numbers) end},
+             {decode, Name, list_to_tuple(Ids), fun(Id) -> ehashids:decode(Ref, Id) end},
+             {decode_safe, Name, list_to_tuple(Ids), fun(Id) -> ehashids:decode_safe(Ref, Id) end}],
+    Codec ++ one_cases(Name, Ref, NumbersList) ++ init_cases(Name, Ref, Count, Magnitude, MinHashLen, Alphabet).
+
+one_cases(Name, Ref, [[_] | _] = NumbersList) ->
+    {ok, Ids} = ehashids:encode_many(Ref, NumbersList),
+    [{encode_one, Name, list_to_tuple([N || [N] <- NumbersList]), fun(N) -> ehashids:encode_one(Ref, N) end},
+     {decode_one, Name, list_to_tuple(Ids), fun(Id) -> ehashids:decode_one(Ref, Id) end}];
+one_cases(_Name, _Ref, _NumbersList) ->
+    [].
+
+%% creating contexts does not depend on the numbers so only run it once per
+%% alphabet/min_len. new_cached repeats the same arguments and so measures a
+%% context cache hit, new_uncached makes the salt unique for every call so
+%% that every call sets a context up, the unique suffix included.
+init_cases(Name, Ref, 1, 32, MinHashLen, Alphabet) ->
+    {ok, Compiled} = ehashids:compile(Ref),
+    [{new_cached, Name, {{?SALT, MinHashLen, Alphabet}}, fun({S, M, A}) -> ehashids:new(S, M, A) end},
+     {new_uncached, Name, {{?SALT, MinHashLen, Alphabet}},
+      fun({S, M, A}) -> ehashids:new(<<S/binary, (integer_to_binary(erlang:unique_integer()))/binary>>, M, A) end},
+     {from_compiled, Name, {Compiled}, fun(C) -> ehashids:from_compiled(C) end}];
+init_cases(_Name, _Ref, _Count, _Magnitude, _MinHashLen, _Alphabet) ->
+    [].
+
+measure(Inputs, Call, Procs, Iterations) ->
+    Parent = self(),
+    Start = erlang:monotonic_time(),
+    Pids = [spawn_link(fun() -> Parent ! {self(), worker(Inputs, Call, Iterations)} end)
+            || _ <- lists:seq(1, Procs)],
+    Samples = lists:append([receive {Pid, S} -> S end || Pid <- Pids]),
+    Elapsed = erlang:convert_time_unit(erlang:monotonic_time() - Start, native, nanosecond),
+    {Procs * Iterations, Elapsed, list_to_tuple(lists:sort(Samples))}.
+
+worker(Inputs, Call, Iterations) ->
+    worker(Inputs, tuple_size(Inputs), Call, Iterations, []).
+
+worker(_Inputs, _Size, _Call, 0, Acc) ->
+    Acc;
+worker(Inputs, Size, Call, N, Acc) ->
+    Input = element(N rem Size + 1, Inputs),
+    T0 = erlang:monotonic_time(),
+    _ = Call(Input),
+    T1 = erlang:monotonic_time(),
+    worker(Inputs, Size, Call, N - 1, [T1 - T0 | Acc]).
+
+report(Op, Case, Procs, {Ops, Elapsed, Samples}) ->
+    io:format("~-14s ~-16s ~5b ~12b ~9b ~9b ~9b~n",
+              [Op, Case, Procs, Ops * 1000000000 div max(1, Elapsed),
+               percentile(Samples, 0.50), percentile(Samples, 0.99), percentile(Samples, 0.999)]).
+
+percentile(Samples, P) ->
+    N = tuple_size(Samples),
+    erlang:convert_time_unit(element(min(N, max(1, ceil(P * N))), Samples), native, nanosecond).
@@ -0,0 +1,333 @@
+/*
+ * Standalone microbenchmark of the encoder and decoder of the NIF, without
+ * the VM. ehashids.c is compiled into the benchmark as it is and the few
+ * enif functions its contexts need are replaced by the shims below, the NIF
+ * entry points are left for the linker to drop. Comparing its numbers with
+ * bench/ehashids_bench.erl separates the cost of the algorithm from the cost
+ * of crossing into the VM.
+ *
+ * The atom case compares ehashids_atom(), which loads an atom made at load,
+ * with make_atom(), which looks one up by name. There is no atom table
+ * without the VM, so the enif atom functions below model the one of erts:
+ * a hashpjw hash of the name, a bucket chain of a table holding as many
+ * atoms as a small node and a compare of the name, under a read lock.
+ *
+ * Build and run with: c_src/build_deps.sh bench
+ */
+#include "../ehashids.c"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_INPUTS 1024
+#define BENCH_MAX_NUMBERS 16
+#define BENCH_ITERATIONS 200000
+#define BENCH_ATOMS 16384
+#define BENCH_ATOM_BUCKETS 8192
+
+static ehashids_priv_t bench_priv;
+
+typedef struct bench_atom_s {
+    struct bench_atom_s *next;
+    unsigned int hash;
+    size_t length;
+    char name[32];
+} bench_atom_t;
+
+static bench_atom_t atom_table[BENCH_ATOMS];
+static bench_atom_t *atom_buckets[BENCH_ATOM_BUCKETS];
+static size_t atom_count;
+static pthread_rwlock_t atom_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void *enif_alloc(size_t size)
+{
+    return malloc(size);
+}
+
+void enif_free(void *ptr)
+{
+    free(ptr);
+}
+
+void *enif_alloc_resource(ErlNifResourceType *type, size_t size)
+{
+    return malloc(size);
+}
+
+// the contexts of the benchmark never get shuffles or a decode cache
+void enif_release_resource(void *obj)
+{
+    free(obj);
+}
+
+void *enif_priv_data(ErlNifEnv *env)
+{
+    return &bench_priv;
+}
+
+static unsigned int atom_hash(const char *name, size_t length)
+{
+    unsigned int h = 0, g;
+    size_t i;
+
+    for(i = 0; i < length; i++){
+        h = (h << 4) + (unsigned char)name[i];
+        if((g = h & 0xf0000000) != 0){
+            h ^= (g >> 24);
+            h ^= g;
+        }
+    }
+
+    return h;
+}
+
+static bench_atom_t *atom_find(const char *name, size_t length, unsigned int hash)
+{
+    bench_atom_t *atom;
+
+    for(atom = atom_buckets[hash % BENCH_ATOM_BUCKETS]; atom != NULL; atom = atom->next){
+        if(atom->hash == hash && atom->length == length && memcmp(atom->name, name, length) == 0){
+            return atom;
+        }
+    }
+
+    return NULL;
+}
+
+int enif_make_existing_atom(ErlNifEnv *env, const char *name, ERL_NIF_TERM *atom, ErlNifCharEncoding encoding)
+{
+    size_t length = strlen(name);
+    unsigned int hash = atom_hash(name, length);
+    bench_atom_t *found;
+
+    pthread_rwlock_rdlock(&atom_lock);
+    found = atom_find(name, length, hash);
+    pthread_rwlock_unlock(&atom_lock);
+    if(found == NULL){
+        return 0;
+    }
+    *atom = (ERL_NIF_TERM)(found - atom_table);
+
+    return 1;
+}
+
+ERL_NIF_TERM enif_make_atom(ErlNifEnv *env, const char *name)
+{
+    size_t length = strlen(name);
+    unsigned int hash = atom_hash(name, length);
+    bench_atom_t *atom;
+
+    pthread_rwlock_wrlock(&atom_lock);
+    atom = atom_find(name, length, hash);
+    if(atom == NULL && atom_count < BENCH_ATOMS && length < sizeof(atom->name)){
+        atom = &atom_table[atom_count++];
+        memcpy(atom->name, name, length + 1);
+        atom->length = length;
+        atom->hash = hash;
+        atom->next = atom_buckets[hash % BENCH_ATOM_BUCKETS];
+        atom_buckets[hash % BENCH_ATOM_BUCKETS] = atom;
+    }
+    pthread_rwlock_unlock(&atom_lock);
+
+    return atom == NULL ? 0 : (ERL_NIF_TERM)(atom - atom_table);
+}
+
+typedef struct {
+    const char *name;
+    size_t numbers;
+    unsigned int magnitude;
+    const char *alphabet;
+    size_t min_hash_length;
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    {"base",         1,  32, EHASHIDS_DEFAULT_ALPHABET, 0},
+    {"numbers=4",    4,  32, EHASHIDS_DEFAULT_ALPHABET, 0},
+    {"numbers=16",   16, 32, EHASHIDS_DEFAULT_ALPHABET, 0},
+    {"magnitude=8",  1,  8,  EHASHIDS_DEFAULT_ALPHABET, 0},
+    {"magnitude=64", 1,  64, EHASHIDS_DEFAULT_ALPHABET, 0},
+    {"alphabet=16",  1,  32, "0123456789abcdef", 0},
+    {"alphabet=36",  1,  32, "0123456789abcdefghijklmnopqrstuvwxyz", 0},
+    {"min_len=16",   1,  32, EHASHIDS_DEFAULT_ALPHABET, 16},
+    {"min_len=32",   1,  32, EHASHIDS_DEFAULT_ALPHABET, 32}
+};
+
+static unsigned long long numbers[BENCH_INPUTS][BENCH_MAX_NUMBERS];
+static char ids[BENCH_INPUTS][1024];
+static unsigned long long samples[BENCH_ITERATIONS];
+
+// new/3 after a context cache miss
+static ehashids_t *bench_init(const char *salt, unsigned int min_hash_length, const char *alphabet)
+{
+    char strings[3 * EHASHIDS_MAX_ALPHABET];
+    ErlNifBinary salt_bin;
+    ErlNifBinary alphabet_bin;
+    hashids_t source;
+    ehashids_t *ctx;
+
+    salt_bin.data = (unsigned char *)salt;
+    salt_bin.size = strlen(salt);
+    alphabet_bin.data = (unsigned char *)alphabet;
+    alphabet_bin.size = strlen(alphabet);
+
+    if(ehashids_check_alphabet(&alphabet_bin) != NULL) return NULL;
+    ehashids_setup(&salt_bin, min_hash_length, &alphabet_bin, strings, &source);
+    if(ehashids_new_context(NULL, &source, &ctx) != NULL) return NULL;
+
+    return ctx;
+}
+
+// decode/2 without building the result terms
+static size_t bench_decode(const ehashids_t *ctx, const char *id, unsigned long long *numbers, size_t max)
+{
+    const char *start;
+    const char *end;
+    size_t count;
+
+    count = ehashids_numbers_count(ctx, id, strlen(id), &start, &end);
+    if(count == 0 || count > max || !ehashids_decode(ctx, start, end, numbers)) return 0;
+
+    return count;
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static unsigned long long random_number(unsigned int magnitude)
+{
+    unsigned long long number = ((unsigned long long)rand() << 42) ^ ((unsigned long long)rand() << 21) ^ (unsigned long long)rand();
+
+    return magnitude >= 64 ? number : number & ((1ULL << magnitude) - 1);
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *op, const char *name, unsigned long long elapsed)
+{
+    qsort(samples, BENCH_ITERATIONS, sizeof(samples[0]), compare_samples);
+    printf("%-14s %-16s %12llu %9llu %9llu %9llu\n",
+        op,
+        name,
+        BENCH_ITERATIONS * 1000000000ULL / (elapsed ? elapsed : 1),
+        samples[BENCH_ITERATIONS / 2],
+        samples[BENCH_ITERATIONS / 100 * 99],
+        samples[BENCH_ITERATIONS / 1000 * 999]);
+}
+
+static void run(const bench_case_t *c)
+{
+    ehashids_t *ctx;
+    unsigned long long decoded[BENCH_MAX_NUMBERS];
+    char buffer[1024];
+    unsigned long long start, t0, t1;
+    size_t i, j, n;
+
+    ctx = bench_init("bench salt", c->min_hash_length, c->alphabet);
+    if(ctx == NULL){
+        fprintf(stderr, "%s: bad parameters\n", c->name);
+        return;
+    }
+
+    for(i = 0; i < BENCH_INPUTS; i++){
+        for(j = 0; j < c->numbers; j++) numbers[i][j] = random_number(c->magnitude);
+        n = ehashids_encode(ctx, ids[i], c->numbers, numbers[i]);
+        ids[i][n] = '\0';
+    }
+
+    start = now_ns();
+    for(i = 0; i < BENCH_ITERATIONS; i++){
+        t0 = now_ns();
+        (void)ehashids_encode(ctx, buffer, c->numbers, numbers[i % BENCH_INPUTS]);
+        t1 = now_ns();
+        samples[i] = t1 - t0;
+    }
+    report("encode", c->name, now_ns() - start);
+
+    start = now_ns();
+    for(i = 0; i < BENCH_ITERATIONS; i++){
+        t0 = now_ns();
+        (void)bench_decode(ctx, ids[i % BENCH_INPUTS], decoded, BENCH_MAX_NUMBERS);
+        t1 = now_ns();
+        samples[i] = t1 - t0;
+    }
+    report("decode", c->name, now_ns() - start);
+
+    if(c->numbers == 1 && c->magnitude == 32){
+        start = now_ns();
+        for(i = 0; i < BENCH_ITERATIONS; i++){
+            t0 = now_ns();
+            enif_release_resource(bench_init("bench salt", c->min_hash_length, c->alphabet));
+            t1 = now_ns();
+            samples[i] = t1 - t0;
+        }
+        report("init", c->name, now_ns() - start);
+    }
+
+    enif_release_resource(ctx);
+}
+
+// the per call cost is a few ns, so every sample times a pass over all the atoms
+static void run_atoms(void)
+{
+    volatile ERL_NIF_TERM sink;
+    char name[32];
+    unsigned long long start, t0, t1;
+    size_t i;
+    int a;
+
+    // the atoms of a node running a few applications, then those of the NIF
+    for(i = 0; atom_count < BENCH_ATOMS - EHASHIDS_ATOM_COUNT; i++){
+        snprintf(name, sizeof(name), "bench_atom_%zu", i);
+        (void)enif_make_atom(NULL, name);
+    }
+    for(a = 0; a < EHASHIDS_ATOM_COUNT; a++){
+        bench_priv.atoms[a] = enif_make_atom(NULL, ehashids_atom_names[a]);
+    }
+
+    start = now_ns();
+    for(i = 0; i < BENCH_ITERATIONS; i++){
+        t0 = now_ns();
+        for(a = 0; a < EHASHIDS_ATOM_COUNT; a++) sink = make_atom(NULL, ehashids_atom_names[a]);
+        t1 = now_ns();
+        samples[i] = t1 - t0;
+    }
+    report("atoms", "lookup", now_ns() - start);
+
+    start = now_ns();
+    for(i = 0; i < BENCH_ITERATIONS; i++){
+        t0 = now_ns();
+        for(a = 0; a < EHASHIDS_ATOM_COUNT; a++) sink = ehashids_atom(NULL, a);
+        t1 = now_ns();
+        samples[i] = t1 - t0;
+    }
+    report("atoms", "load", now_ns() - start);
+    (void)sink;
+}
+
+int main(void)
+{
+    size_t i;
+
+    srand(42);
+    printf("%-14s %-16s %12s %9s %9s %9s\n", "op", "case", "ops/s", "p50 ns", "p99 ns", "p999 ns");
+    for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        run(&cases[i]);
+    }
+    run_atoms();
+
+    return 0;
+}
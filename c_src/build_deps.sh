@@ -1,7 +1,5 @@
 #!/usr/bin/env bash
 
-HASHIDS_VSN="v1.2.1"
-
 # /bin/sh on Solaris is not a POSIX compatible shell, but /usr/bin/ksh is.
 if [ `uname -s` = 'SunOS' -a "${POSIX_SHELL}" != "true" ]; then
     POSIX_SHELL="true"
@@ -18,8 +16,6 @@ if [ `basename $PWD` != "c_src" ]; then
     cd c_src
 fi
 
-BASEDIR="$PWD/hashids.c"
-
 # detecting gmake and if exists use it
 # if not use make
 # (code from github.com/tuncer/re2/c_src/build_deps.sh
@@ -48,21 +44,24 @@ case "$1" in
         fi
         ;;
 
-    test)
-        export CFLAGS="$CFLAGS -fPIC -I $BASEDIR/include"
-        export CXXFLAGS="$CXXFLAGS -fPIC -I $BASEDIR/include"
-        export LDFLAGS="$LDFLAGS -L$BASEDIR/lib"
-        export LD_LIBRARY_PATH="$BASEDIR/lib:$LD_LIBRARY_PATH"
-
-        (cd hashids.c && $MAKE check)
-
+    bench)
+        # the benchmark compiles ehashids.c in, the linker drops the NIF entry points
+        ERTS_INCLUDE=`erl -noshell -eval 'io:format("~s/erts-~s/include", [code:root_dir(), erlang:system_info(version)]), halt().'`
+        BENCH_CFLAGS="-O3 $CFLAGS -I $ERTS_INCLUDE -ffunction-sections -fdata-sections"
+        if [ "$2" = "pgo" ]; then
+            # trained on its own cases, like EHASHIDS_PGO=generate on the Erlang benchmark
+            rm -rf bench/pgo
+            ${CC:-cc} $BENCH_CFLAGS -fprofile-generate -fprofile-dir=bench/pgo \
+                bench/hashids_bench.c -Wl,--gc-sections -lm -lpthread -o bench/hashids_bench
+            ./bench/hashids_bench > /dev/null
+            BENCH_CFLAGS="$BENCH_CFLAGS -fprofile-use -fprofile-dir=bench/pgo -fprofile-correction"
+        fi
+        ${CC:-cc} $BENCH_CFLAGS bench/hashids_bench.c -Wl,--gc-sections -lm -lpthread -o bench/hashids_bench
+        ./bench/hashids_bench
         ;;
 
-    get-deps)
-        if [ ! -d hashids.c ]; then
-            git clone https://github.com/tzvetkoff/hashids.c.git
-            (cd hashids.c && git checkout -b build $HASHIDS_VSN)
-        fi
+    pgo-clean)
+        rm -rf pgo bench/pgo
         ;;
 
     *)
@@ -74,37 +73,5 @@ case "$1" in
             rm ../priv/ehashids.so
           fi
         fi
-        priv_files=$(shopt -s nullglob dotglob; echo ../priv/*)
-        if (( ${#priv_files} )); then
-          :
-        else
-          export MACOSX_DEPLOYMENT_TARGET=10.8
-
-          export CFLAGS="$CFLAGS -fPIC -I $BASEDIR/include"
-          export CXXFLAGS="$CXXFLAGS -fPIC -I $BASEDIR/include"
-          export LDFLAGS="$LDFLAGS -L$BASEDIR/lib"
-          export LD_LIBRARY_PATH="$BASEDIR/lib:$LD_LIBRARY_PATH"
-          export HASHIDS_VSN="$HASHIDS_VSN"
-
-          if [ ! -d hashids.c ]; then
-              git clone https://github.com/tzvetkoff/hashids.c.git
-              (cd hashids.c && git checkout -b build $HASHIDS_VSN)
-          fi
-
-          if [[ "$OSTYPE" == "darwin"* ]]; then
-              path_to_libtool=$(which libtool)
-              path_to_autoreconf=$(which autoreconf)
-              if [ -z ${path_to_libtool} ] || [ -z ${path_to_autoreconf} ] ; then
-                echo "Build tools are MISSING please install them with: brew install autoconf automake libtool"
-              fi
-          fi
-
-          if [ ! -f hashids.c/config.h ]; then
-            (cd hashids.c && ($MAKE clean || echo skip) && ./bootstrap && ./configure --enable-static=yes && $MAKE -j9 all)
-          else
-            (cd hashids.c && ($MAKE clean || echo skip) && ./bootstrap && ./configure --enable-static=yes && $MAKE -j9 all)
-          fi
-        fi
         ;;
 esac
-
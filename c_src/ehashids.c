@@ -1,12 +1,85 @@
 #include <erl_nif.h>
-#include <hashids.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 
-#define EHASHIDS_MAX_NUMBERS 65536
+/* the defaults of new/0..3, same as the other hashids implementations */
+#define EHASHIDS_DEFAULT_ALPHABET "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
+#define EHASHIDS_DEFAULT_SALT ""
+#define EHASHIDS_DEFAULT_SEPARATORS "cfhistuCFHISTU"
+#define EHASHIDS_DEFAULT_MIN_HASH_LENGTH 0
+#define EHASHIDS_MIN_ALPHABET_LENGTH 16
+/* alphabets are made of unique bytes so they can never be longer than this */
+#define EHASHIDS_MAX_ALPHABET 256
+/* scratch space kept on the stack before falling back to enif_alloc */
+#define EHASHIDS_STACK_NUMBERS 16
+#define EHASHIDS_STACK_BUFFER 512
+/* classes of the per context character lookup table */
+#define EHASHIDS_CLASS_INVALID 0
+#define EHASHIDS_CLASS_ALPHABET 1
+#define EHASHIDS_CLASS_SEPARATOR 2
+#define EHASHIDS_CLASS_GUARD 3
+/* batch NIFs check their run time every time this many bytes of ids were made or read */
+#define EHASHIDS_BATCH_CHECK_BYTES 1024
+/* length of a scheduler timeslice in microseconds */
+#define EHASHIDS_TIMESLICE_USEC 1000
+/* ids longer than this are encoded or decoded on a dirty CPU scheduler */
+#define EHASHIDS_DIRTY_BYTES 4096
+/* and so are encodings of numbers wider than this, their cost grows quadratically */
+#define EHASHIDS_DIRTY_BIG_BITS 1024
+/* encode_into/3 output larger than this is built on a dirty CPU scheduler */
+#define EHASHIDS_DIRTY_INTO_BYTES (16 * EHASHIDS_DIRTY_BYTES)
+/* layout of the compile/1 binary: header, strings, then a CRC-32 of both */
+#define EHASHIDS_COMPILED_MAGIC "EHID"
+#define EHASHIDS_COMPILED_VERSION 1
+#define EHASHIDS_COMPILED_HEADER 20
+#define EHASHIDS_COMPILED_TRAILER 4
+/* widest number encode and decode accept */
+#define EHASHIDS_BIG_BITS_MAX 4096
+/* the context cache never holds more entries than this, whatever load_info asks for */
+#define EHASHIDS_CACHE_MAX 65536
+/* number of counter stripes of every ehashids_stats_t, threads are spread over them */
+#define EHASHIDS_STATS_STRIPES 16
+/* counters written by several threads are aligned to this */
+#define EHASHIDS_CACHE_LINE 64
+/* the decode cache keeps ids up to this long holding up to this many numbers, one cache line each */
+#define EHASHIDS_DECODE_CACHE_ID 36
+#define EHASHIDS_DECODE_CACHE_NUMBERS 2
+/* slots an id can be kept in, the clock hand of each set goes over these */
+#define EHASHIDS_DECODE_CACHE_WAYS 8
+/* a decode cache never holds more entries than this */
+#define EHASHIDS_DECODE_CACHE_MAX (1 << 24)
+/* the canonical flag of a decode cache entry decoded without the decode_safe/2 check */
+#define EHASHIDS_CANONICAL_UNKNOWN 2
+/*
+ * Version of the layouts of ehashids_priv_t, ehashids_shared_t and
+ * ehashids_t, bump it whenever any of them changes. The resource types keep
+ * their names across versions so an upgrade always takes over the live
+ * contexts: every context starts with EHASHIDS_CONTEXT_MAGIC and the version
+ * it was made with, ehashids_context_of() rebuilds the ones it can't read
+ * and ehashids_context_dtor() frees every layout it knows. The cache and the
+ * counters are only shared with a library of the same version.
+ */
+#define EHASHIDS_LAYOUT_VERSION 6
+#define EHASHIDS_PRIV_MAGIC 0x44504845u /* "EHPD" */
+#define EHASHIDS_CONTEXT_MAGIC 0x58434845u /* "EHCX" */
+#define EHASHIDS_RESOURCE_TYPE "hashids_type"
+#define EHASHIDS_KEYRING_TYPE "hashids_keyring"
+/* ids made by encode_range/3 share a binary this many at a time, fewer when they could outgrow EHASHIDS_DIRTY_BYTES */
+#define EHASHIDS_RANGE_BATCH 256
+/* the per lottery alphabets of encode_range/3 take at most this many bytes, deeper padding is shuffled per id */
+#define EHASHIDS_RANGE_STATE_MAX 262144
+/* a keyring holds at most this many contexts */
+#define EHASHIDS_KEYRING_MAX 64
+/* dirty schedulers are always available from NIF 2.12 (OTP 20) */
+#if ERL_NIF_MAJOR_VERSION > 2 || \
+    (ERL_NIF_MAJOR_VERSION == 2 && ERL_NIF_MINOR_VERSION >= 12) || \
+    defined(ERL_NIF_DIRTY_SCHEDULER_SUPPORT)
+#   define EHASHIDS_DIRTY_NIFS 1
+#endif
 /* branch prediction hinting */
 #ifndef __has_builtin
 #   define __has_builtin(x) (0)
@@ -18,25 +91,345 @@
 #   define EHASHIDS_LIKELY(x)        (x)
 #   define EHASHIDS_UNLIKELY(x)      (x)
 #endif
+/* vectorized id validation, picked at load time from what the CPU supports */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   define EHASHIDS_SIMD_X86 1
+#   include <immintrin.h>
+#endif
+
 
+/*
+ * The parameters of a context, with the field names of hashids.c. The
+ * strings are not terminated, they are read by length only.
+ */
+typedef struct {
+    char *alphabet;
+    size_t alphabet_length;
+    char *salt;
+    size_t salt_length;
+    char *separators;
+    size_t separators_count;
+    char *guards;
+    size_t guards_count;
+    size_t min_hash_length;
+} hashids_t;
 
 static ErlNifResourceType *hashids_type = NULL;
+static ErlNifResourceType *keyring_type = NULL;
 
 static ERL_NIF_TERM hashids_init_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 static ERL_NIF_TERM hashids_estimate_encoded_size_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 static ERL_NIF_TERM hashids_encode_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_one_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_one_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_many_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_many_continue_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_many_one_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_many_one_continue_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_many_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_many_one_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_range_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_range_continue_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_range_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_into_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_encode_into_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 static ERL_NIF_TERM hashids_decode_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_safe_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_safe_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_one_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_one_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_many_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_many_continue_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_many_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_transcode_chunk_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_transcode_chunk_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 static ERL_NIF_TERM hashids_compile_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 static ERL_NIF_TERM hashids_new_from_compiled_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_cache_info_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_info_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_stats_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_memory_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_new_keyring_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_any_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_decode_any_dirty_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_is_valid_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_precompute_shuffles_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
+static ERL_NIF_TERM hashids_enable_decode_cache_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 
 static int handle_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info);
-static void garbage_collect_hashids(ErlNifEnv *env, void *p);
+static void handle_unload(ErlNifEnv *env, void *priv_data);
 static int handle_upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info);
 
+/*
+ * Usage counters. A call adds up its counts in an ehashids_tally_t and then
+ * flushes them once, with relaxed atomic adds, into the stripe of the
+ * calling thread. Stripes are one cache line each so threads do not contend
+ * on the same line, reads sum up all the stripes.
+ */
+enum {
+    EHASHIDS_STAT_ENCODE,       /* ids encoded */
+    EHASHIDS_STAT_DECODE,       /* ids decoded, successfully or not */
+    EHASHIDS_STAT_INVALID_HASH, /* decodes failed with invalid_hash */
+    EHASHIDS_STAT_UNSAFE,       /* decodes failed with unsafe */
+    EHASHIDS_STAT_ERROR,        /* any other failed encode or decode */
+    EHASHIDS_STAT_WIDE,         /* ids holding numbers wider than 64 bits */
+    EHASHIDS_STAT_REGROW,       /* scratch buffers grown onto the heap */
+    EHASHIDS_STAT_BYTES,        /* bytes allocated for ids and scratch buffers */
+    EHASHIDS_STAT_CACHE_HIT,    /* decodes answered by the decode cache */
+    EHASHIDS_STAT_CACHE_MISS,   /* decodes of cacheable ids the decode cache did not have */
+    EHASHIDS_STAT_CACHE_EVICT,  /* decode cache entries replaced by another id */
+    EHASHIDS_STAT_COUNT
+};
+
+static const char *ehashids_stat_names[EHASHIDS_STAT_COUNT] = {
+    "encode", "decode", "invalid_hash", "unsafe", "error", "wide", "regrow", "bytes",
+    "decode_cache_hit", "decode_cache_miss", "decode_cache_eviction"
+};
+
+typedef struct {
+    uint64_t counts[EHASHIDS_STAT_COUNT];
+} ehashids_tally_t;
+
+typedef struct {
+    ehashids_tally_t stripes[EHASHIDS_STATS_STRIPES];
+} ehashids_stats_t;
+
+/*
+ * The alphabet after the first shuffle of a number, for every lottery
+ * character. That shuffle only depends on the lottery, the salt and the
+ * alphabet of the context so it can be done once up front. Row r is for the
+ * lottery character at position r of the alphabet and holds the shuffled
+ * alphabet and its byte to position table. bytes is the whole allocation.
+ */
+typedef struct {
+    size_t bytes;
+    char *alphabets;
+    unsigned char *indexes;
+    char data[];
+} ehashids_shuffles_t;
+
+/*
+ * A decoded id kept by the decode cache. canonical tells whether the numbers
+ * encode back to the id, the decode_safe/2 check, or is
+ * EHASHIDS_CANONICAL_UNKNOWN when the id was decoded without that check.
+ */
+typedef struct {
+    uint64_t hash;
+    unsigned long long numbers[EHASHIDS_DECODE_CACHE_NUMBERS];
+    unsigned char id[EHASHIDS_DECODE_CACHE_ID];
+    unsigned char id_length; /* 0 for a free slot */
+    unsigned char count;
+    unsigned char canonical;
+    unsigned char referenced;
+} ehashids_decoded_t;
+
+/*
+ * A part of the decode cache. An id goes to the set of
+ * EHASHIDS_DECODE_CACHE_WAYS slots picked by its hash and, once they are
+ * all taken, replaces the first one not hit since the clock hand of the set
+ * last passed over it.
+ */
+typedef struct {
+    ErlNifMutex *lock;
+    ehashids_decoded_t *slots;
+    unsigned char *hands;
+} ehashids_decode_part_t;
+
+/*
+ * The decode cache of a context, made by enable_decode_cache/2. It has one
+ * part per counter stripe and a thread only uses the part of its stripe, so
+ * threads hardly ever wait on each other and a hot id ends up in the part
+ * of every scheduler decoding it. bytes is the whole allocation.
+ */
+typedef struct {
+    size_t bytes;
+    size_t sets; /* per part, a power of two */
+    ehashids_decode_part_t parts[EHASHIDS_STATS_STRIPES];
+    char data[];
+} ehashids_decode_cache_t;
+
+/*
+ * The hashids_type resource. magic and layout come first and never move.
+ * Next to the hashids_t it holds byte indexed
+ * lookup tables built once when the context is created: the class of every
+ * byte and, for alphabet characters, their position in the alphabet.
+ * When every valid byte is ASCII they are also kept as a bitmap, bit h of
+ * bitmap[l] is set when byte h << 4 | l is valid, for the vectorized checks.
+ * Everything read by encode and decode comes first. The counters, written
+ * by every call, follow in data at the first cache line boundary so their
+ * stripes don't share lines, then the alphabet, salt, separators and guards
+ * strings. A whole context is a single allocation owned and accounted by
+ * the VM, bytes is its size.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t layout;
+    hashids_t hashids;
+    unsigned char classes[256];
+    unsigned char indexes[256];
+    unsigned char bitmap[16];
+    int ascii;
+    ehashids_shuffles_t *shuffles; /* NULL until precomputed, then never changes */
+    ehashids_decode_cache_t *decode_cache; /* NULL until enabled, then never changes */
+    ehashids_stats_t *stats;
+    size_t bytes;
+    char data[];
+} ehashids_t;
+
+/*
+ * The hashids_type resource of the libraries that linked hashids.c: a
+ * pointer to its hashids_t, of which this is the layout, freed with
+ * hashids_free(). Once ehashids_context_of() rebuilt it the pointer is
+ * replaced by the rebuilt context with the lowest bit set, the resource
+ * then holds a reference to that context.
+ */
+typedef struct {
+    char *alphabet;
+    char *alphabet_copy_1;
+    char *alphabet_copy_2;
+    size_t alphabet_length;
+    char *salt;
+    size_t salt_length;
+    char *separators;
+    size_t separators_count;
+    char *guards;
+    size_t guards_count;
+    size_t min_hash_length;
+} ehashids_legacy_t;
+
+/*
+ * The keyring_type resource, contexts tried in order by decode_any/2. It
+ * holds a reference to each of them.
+ */
+typedef struct {
+    size_t count;
+    ehashids_t *keys[];
+} ehashids_keyring_t;
+
+typedef struct {
+    unsigned long long *numbers;
+    size_t numbers_size;
+    char *buffer;
+    size_t buffer_size;
+    ehashids_tally_t tally;
+    unsigned long long numbers_stack[EHASHIDS_STACK_NUMBERS];
+    char buffer_stack[EHASHIDS_STACK_BUFFER];
+} ehashids_scratch_t;
+
+/*
+ * A context kept in the cache. The key is the salt followed by the alphabet
+ * as they were passed to new/0..3, before any shuffling.
+ */
+typedef struct {
+    uint64_t hash;
+    ehashids_t *ctx;
+    char *key;
+    size_t salt_size;
+    size_t alphabet_size;
+    unsigned int min_hash_length;
+    int referenced;
+    int next;
+} ehashids_cache_entry_t;
+
+/*
+ * Contexts created by new/0..3 keyed by their parameters, so identical calls
+ * share one resource instead of shuffling again. Entries are chained from
+ * buckets by index and evicted with the clock algorithm once capacity is
+ * reached. Everything is guarded by lock, which is only created when the
+ * capacity is not zero.
+ */
+typedef struct {
+    ErlNifMutex *lock;
+    ehashids_cache_entry_t *entries;
+    int *buckets;
+    size_t capacity;
+    size_t bucket_mask;
+    size_t size;
+    size_t hand;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} ehashids_cache_t;
+
+/*
+ * Atoms of the results and of the common error reasons, made once when the
+ * library is loaded. make_atom() finds these by name, the hot paths index
+ * them directly with ehashids_atom().
+ */
+enum {
+    EHASHIDS_ATOM_OK,
+    EHASHIDS_ATOM_ERROR,
+    EHASHIDS_ATOM_TRUE,
+    EHASHIDS_ATOM_FALSE,
+    EHASHIDS_ATOM_INVALID_HASH,
+    EHASHIDS_ATOM_UNSAFE,
+    EHASHIDS_ATOM_NUMBERS,
+    EHASHIDS_ATOM_ID,
+    EHASHIDS_ATOM_IDS,
+    EHASHIDS_ATOM_ALLOC,
+    EHASHIDS_ATOM_BAD_RESOURCE,
+    EHASHIDS_ATOM_ARITY,
+    EHASHIDS_ATOM_BADARG,
+    EHASHIDS_ATOM_ENCODE,
+    EHASHIDS_ATOM_DECODE,
+    EHASHIDS_ATOM_COUNT
+};
+
+static const char *ehashids_atom_names[EHASHIDS_ATOM_COUNT] = {
+    "ok", "error", "true", "false", "invalid_hash", "unsafe", "numbers", "id", "ids",
+    "alloc", "bad_resource", "arity", "badarg", "encode", "decode"
+};
+
+/*
+ * State that survives a hot upgrade. A library with the same layout version
+ * shares it with the one it replaces, so cached contexts stay warm and the
+ * counters keep counting, and the last one unloaded frees it. legacy_lock
+ * serializes the rebuild of old contexts and exists whatever the cache size.
+ */
+typedef struct {
+    ehashids_cache_t cache;
+    ehashids_stats_t stats;
+    ErlNifMutex *legacy_lock;
+    int users;
+} ehashids_shared_t;
+
+/*
+ * The private data of a loaded library. magic and version come first and
+ * never move, they tell a newer library whether it can share this one's
+ * state. The libraries before them had either no private data or a mutex
+ * pointer in that place.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    ehashids_shared_t *shared;
+    int precompute;
+    ERL_NIF_TERM atoms[EHASHIDS_ATOM_COUNT];
+} ehashids_priv_t;
+
+static ERL_NIF_TERM ehashids_atom(ErlNifEnv *env, int atom)
+{
+    return ((const ehashids_priv_t *)enif_priv_data(env))->atoms[atom];
+}
+
+static void ehashids_shuffle(char *str, size_t str_length, const char *salt, size_t salt_length);
+static size_t ehashids_encode(const ehashids_t *ctx, char *buffer, size_t numbers_count, const unsigned long long *numbers);
+static size_t ehashids_numbers_count(const ehashids_t *ctx, const char *str, size_t len, const char **start, const char **end);
+static int ehashids_decode(const ehashids_t *ctx, const char *start, const char *end, unsigned long long *numbers);
+static const char *ehashids_make_resource(ErlNifEnv *env, const hashids_t *source, ERL_NIF_TERM *out);
+
 static ERL_NIF_TERM make_error_tuple_from_string(ErlNifEnv* env, const char *error);
 static ERL_NIF_TERM make_error_tuple(ErlNifEnv* env, ERL_NIF_TERM error);
 static ERL_NIF_TERM make_atom(ErlNifEnv* env, const char* atom);
 
+// {error, Reason} for a reason made at load
+static ERL_NIF_TERM ehashids_error(ErlNifEnv *env, int atom)
+{
+    return make_error_tuple(env, ehashids_atom(env, atom));
+}
+
 /* ERL_NIF >= 2.8 */
 #if ERL_NIF_MAJOR_VERSION > 2 || \
     (ERL_NIF_MAJOR_VERSION == 2 && \
@@ -49,9 +442,27 @@ static ErlNifFunc nif_funcs[] = {
     {"new",                   0, hashids_init_nif,                  0},
     {"estimate_encoded_size", 2, hashids_estimate_encoded_size_nif, 0},
     {"encode",                2, hashids_encode_nif,                0},
+    {"encode_one",            2, hashids_encode_one_nif,            0},
+    {"encode_many",           2, hashids_encode_many_nif,           0},
+    {"encode_many_one",       2, hashids_encode_many_one_nif,       0},
+    {"encode_range",          3, hashids_encode_range_nif,          0},
+    {"encode_into",           3, hashids_encode_into_nif,           0},
     {"decode",                2, hashids_decode_nif,                0},
+    {"decode_safe",           2, hashids_decode_safe_nif,           0},
+    {"decode_one",            2, hashids_decode_one_nif,            0},
+    {"decode_many",           2, hashids_decode_many_nif,           0},
+    {"transcode_chunk",       4, hashids_transcode_chunk_nif,       0},
     {"compile",               1, hashids_compile_nif,               0},
-    {"from_compiled",         1, hashids_new_from_compiled_nif,     0}
+    {"from_compiled",         1, hashids_new_from_compiled_nif,     0},
+    {"cache_info",            0, hashids_cache_info_nif,            0},
+    {"info",                  1, hashids_info_nif,                  0},
+    {"stats",                 0, hashids_stats_nif,                 0},
+    {"memory",                1, hashids_memory_nif,                0},
+    {"new_keyring",           1, hashids_new_keyring_nif,           0},
+    {"decode_any",            2, hashids_decode_any_nif,            0},
+    {"is_valid",              2, hashids_is_valid_nif,              0},
+    {"precompute_shuffles",   1, hashids_precompute_shuffles_nif,   0},
+    {"enable_decode_cache",   2, hashids_enable_decode_cache_nif,   0}
 };
 #else
 static ErlNifFunc nif_funcs[] = {
@@ -61,16 +472,88 @@ static ErlNifFunc nif_funcs[] = {
     {"new",                   0, hashids_init_nif},
     {"estimate_encoded_size", 2, hashids_estimate_encoded_size_nif},
     {"encode",                2, hashids_encode_nif},
+    {"encode_one",            2, hashids_encode_one_nif},
+    {"encode_many",           2, hashids_encode_many_nif},
+    {"encode_many_one",       2, hashids_encode_many_one_nif},
+    {"encode_range",          3, hashids_encode_range_nif},
+    {"encode_into",           3, hashids_encode_into_nif},
     {"decode",                2, hashids_decode_nif},
+    {"decode_safe",           2, hashids_decode_safe_nif},
+    {"decode_one",            2, hashids_decode_one_nif},
+    {"decode_many",           2, hashids_decode_many_nif},
+    {"transcode_chunk",       4, hashids_transcode_chunk_nif},
     {"compile",               1, hashids_compile_nif},
-    {"from_compiled",         1, hashids_new_from_compiled_nif}
+    {"from_compiled",         1, hashids_new_from_compiled_nif},
+    {"cache_info",            0, hashids_cache_info_nif},
+    {"info",                  1, hashids_info_nif},
+    {"stats",                 0, hashids_stats_nif},
+    {"memory",                1, hashids_memory_nif},
+    {"new_keyring",           1, hashids_new_keyring_nif},
+    {"decode_any",            2, hashids_decode_any_nif},
+    {"is_valid",              2, hashids_is_valid_nif},
+    {"precompute_shuffles",   1, hashids_precompute_shuffles_nif},
+    {"enable_decode_cache",   2, hashids_enable_decode_cache_nif}
 };
 #endif
 
-static void garbage_collect_hashids(ErlNifEnv *env, void *p)
+static int ehashids_cache_init(ehashids_cache_t *cache, size_t capacity);
+static ehashids_shared_t *ehashids_shared_create(size_t capacity);
+static void ehashids_shared_free(ehashids_shared_t *shared);
+static void ehashids_cache_free(ehashids_cache_t *cache);
+static void ehashids_valid_select(void);
+static unsigned int ehashids_stripe(void);
+static void ehashids_context_dtor(ErlNifEnv *env, void *obj);
+static void ehashids_keyring_dtor(ErlNifEnv *env, void *obj);
+
+/*
+ * Sets up the private data. load_info is a map with the capacity of the
+ * context cache as cache_size and whether new contexts get their shuffles
+ * precomputed as precompute_shuffles, a bare integer is the cache size.
+ * When shared is given it is used as it is, cache size included.
+ */
+static ehashids_priv_t *ehashids_priv_create(ErlNifEnv *env, ERL_NIF_TERM load_info, ehashids_shared_t *shared)
 {
-    hashids_t *hashids = *(hashids_t **)p;
-    hashids_free(hashids);
+    ehashids_priv_t *priv;
+    ERL_NIF_TERM value;
+    unsigned int capacity = 0;
+    int precompute = 0;
+    int i;
+
+    if(enif_is_map(env, load_info)){
+        if(enif_get_map_value(env, load_info, make_atom(env, "cache_size"), &value) &&
+           !enif_get_uint(env, value, &capacity)){
+            capacity = 0;
+        }
+        if(enif_get_map_value(env, load_info, make_atom(env, "precompute_shuffles"), &value)){
+            precompute = enif_is_identical(value, make_atom(env, "true"));
+        }
+    } else if(!enif_get_uint(env, load_info, &capacity)){
+        capacity = 0;
+    }
+    if(capacity > EHASHIDS_CACHE_MAX) capacity = EHASHIDS_CACHE_MAX;
+
+    priv = (ehashids_priv_t *)enif_alloc(sizeof(ehashids_priv_t));
+    if(EHASHIDS_UNLIKELY(priv == NULL)) return NULL;
+    priv->magic = EHASHIDS_PRIV_MAGIC;
+    priv->version = EHASHIDS_LAYOUT_VERSION;
+    priv->precompute = precompute;
+    for(i = 0; i < EHASHIDS_ATOM_COUNT; i++){
+        priv->atoms[i] = enif_make_atom(env, ehashids_atom_names[i]);
+    }
+
+    if(shared != NULL){
+        __atomic_add_fetch(&shared->users, 1, __ATOMIC_ACQ_REL);
+        priv->shared = shared;
+        return priv;
+    }
+
+    priv->shared = ehashids_shared_create(capacity);
+    if(EHASHIDS_UNLIKELY(priv->shared == NULL)){
+        enif_free(priv);
+        return NULL;
+    }
+
+    return priv;
 }
 
 static int handle_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info)
@@ -78,12 +561,13 @@ static int handle_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info)
     ErlNifResourceType *rt;
     ErlNifResourceFlags rf;
 
+    // a module deleted and loaded again finds the contexts of its last library still alive
     rt = enif_open_resource_type(
         env,
         NULL,
-        "hashids_type",
-        garbage_collect_hashids,
-        ERL_NIF_RT_CREATE,
+        EHASHIDS_RESOURCE_TYPE,
+        ehashids_context_dtor,
+        ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER,
         &rf
     );
 
@@ -91,564 +575,3726 @@ static int handle_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info)
 
     hashids_type = rt;
 
+    rt = enif_open_resource_type(env, NULL, EHASHIDS_KEYRING_TYPE, ehashids_keyring_dtor,
+                                 ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, &rf);
+    if(EHASHIDS_UNLIKELY(rt == NULL)) return -1;
+
+    keyring_type = rt;
+    ehashids_valid_select();
+
+    *priv = ehashids_priv_create(env, load_info, NULL);
+    if(EHASHIDS_UNLIKELY(*priv == NULL)) return -1;
+
     return 0;
 }
 
 static int handle_upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
 {
+    const ehashids_priv_t *old = (const ehashids_priv_t *)*old_priv_data;
+    ehashids_shared_t *shared = NULL;
+    ErlNifResourceType *rt;
+    ErlNifResourceFlags rf;
+    ErlNifResourceFlags keyring_rf;
+
+    // the old contexts, of any layout, are read and destroyed by this code from now on
+    rt = enif_open_resource_type(
+        env,
+        NULL,
+        EHASHIDS_RESOURCE_TYPE,
+        ehashids_context_dtor,
+        ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER,
+        &rf
+    );
+
+    if(EHASHIDS_UNLIKELY(rt == NULL)) return -1;
+
+    hashids_type = rt;
+
+    rt = enif_open_resource_type(env, NULL, EHASHIDS_KEYRING_TYPE, ehashids_keyring_dtor,
+                                 ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, &keyring_rf);
+    if(EHASHIDS_UNLIKELY(rt == NULL)) return -1;
+
+    keyring_type = rt;
+    ehashids_valid_select();
+
+    // the cache holds contexts of the old type, it is only shared when that is ours
+    if(old != NULL && old->magic == EHASHIDS_PRIV_MAGIC && old->version == EHASHIDS_LAYOUT_VERSION &&
+       (rf & ERL_NIF_RT_TAKEOVER)){
+        shared = old->shared;
+    }
+
+    *priv_data = ehashids_priv_create(env, load_info, shared);
+    if(EHASHIDS_UNLIKELY(*priv_data == NULL)) return -1;
+
     return 0;
 }
 
-
-static ERL_NIF_TERM hashids_init_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+static void handle_unload(ErlNifEnv *env, void *priv_data)
 {
-    hashids_t *hashids;
-    hashids_t **resource_ref;
-    int res;
-    char *salt = NULL;
-    char *alphabet = NULL;
-    ErlNifBinary salt_bin;
-    ErlNifBinary alphabet_bin;
-    ERL_NIF_TERM resource;
-    unsigned int min_hash_length;
+    ehashids_priv_t *priv = (ehashids_priv_t *)priv_data;
 
-    if(argc > 0){
-        res = enif_inspect_binary(env, argv[0], &salt_bin);
-        if(res == 0){
-            return make_error_tuple_from_string(env, "salt");
-        }
-        salt = (char *)enif_alloc(salt_bin.size + 1);
-        if(salt == NULL){
-            return make_error_tuple_from_string(env, "alloc");
-        }
-        (void)memcpy(salt, salt_bin.data, salt_bin.size);
-        salt[salt_bin.size] = '\0';
+    if(__atomic_sub_fetch(&priv->shared->users, 1, __ATOMIC_ACQ_REL) == 0){
+        ehashids_shared_free(priv->shared);
     }
+    enif_free(priv);
+}
 
-    if(argc > 1){
-        res = enif_get_uint(env, argv[1], &min_hash_length);
-        if(res == 0){
-            enif_free(salt);
-            return make_error_tuple_from_string(env, "max_hash_length");
-        }
-    }
+/*
+ * The hashids algorithm, as in hashids.c and the other implementations of
+ * it. hashids.c shuffles inside buffers of the context, so a context could
+ * only ever be used by one scheduler at a time. This version treats the
+ * context as read-only and keeps its scratch alphabets on the stack, which
+ * lets a single reference be shared by any number of processes. Being in
+ * this file it also gets inlined into the NIFs.
+ */
+static void ehashids_shuffle(char *str, size_t str_length, const char *salt, size_t salt_length)
+{
+    size_t i, j, v, p;
+    char temp;
 
-    if(argc > 2){
-        res = enif_inspect_binary(env, argv[2], &alphabet_bin);
-        if(EHASHIDS_UNLIKELY(res == 0)){
-            enif_free(salt);
-            return make_error_tuple_from_string(env, "alphabet");
-        }
-        alphabet = (char *)enif_alloc(alphabet_bin.size + 1);
-        if(EHASHIDS_UNLIKELY(alphabet == NULL)){
-            enif_free(salt);
-            return make_error_tuple_from_string(env, "alphabet_alloc");
-        }
-        (void)memcpy(alphabet, alphabet_bin.data, alphabet_bin.size);
-        alphabet[alphabet_bin.size] = '\0';
-    }
-
-    switch(argc){
-    case 0:
-    case 1:    
-        hashids = hashids_init(salt);
-        break;
-    case 2:
-        hashids = hashids_init2(salt, min_hash_length);
-        break;
-    case 3:
-        hashids = hashids_init3(salt, min_hash_length, alphabet);
-        break;
-    default:
-        if(salt) enif_free(salt);
-        if(alphabet) enif_free(alphabet);
-        return make_error_tuple_from_string(env, "arity");
-    }
-
-    if (EHASHIDS_UNLIKELY(!hashids)) {
-        switch (hashids_errno) {
-            case HASHIDS_ERROR_ALLOC:
-                if (salt) enif_free(salt);
-                if (alphabet) enif_free(alphabet);
-                return make_error_tuple_from_string(env, "alloc");
-
-            case HASHIDS_ERROR_ALPHABET_LENGTH:
-                if (salt) enif_free(salt);
-                if (alphabet) enif_free(alphabet);
-                return make_error_tuple_from_string(env, "alphabet_length");
-
-            case HASHIDS_ERROR_ALPHABET_SPACE:
-                if (salt) enif_free(salt);
-                if (alphabet) enif_free(alphabet);
-                return make_error_tuple_from_string(env, "alphabet_space");
+    if(salt_length == 0 || str_length < 2) return;
 
-            default:
-                if (salt) enif_free(salt);
-                if (alphabet) enif_free(alphabet);
-                return make_error_tuple_from_string(env, "init");
-        }
+    for(i = str_length - 1, v = 0, p = 0; i > 0; --i, ++v){
+        v %= salt_length;
+        p += salt[v];
+        j = (salt[v] + v + p) % i;
+
+        temp = str[i];
+        str[i] = str[j];
+        str[j] = temp;
     }
+}
+
+// Same as ehashids_shuffle() but also keeps the byte to position table of str up to date
+static void ehashids_shuffle_indexed(char *str, size_t str_length, const char *salt, size_t salt_length, unsigned char *indexes)
+{
+    size_t i, j, v, p;
+    char temp;
 
-    resource_ref = (hashids_t **)enif_alloc_resource(hashids_type, sizeof(hashids_t *));
-    *resource_ref = hashids;
+    if(salt_length == 0 || str_length < 2) return;
 
-    if(salt) enif_free(salt);
-    if(alphabet) enif_free(alphabet);
+    for(i = str_length - 1, v = 0, p = 0; i > 0; --i, ++v){
+        v %= salt_length;
+        p += salt[v];
+        j = (salt[v] + v + p) % i;
 
-    resource = enif_make_resource(env, resource_ref);
-    enif_release_resource(resource_ref);
-    
-    return resource;
+        temp = str[i];
+        str[i] = str[j];
+        str[j] = temp;
+        indexes[(unsigned char)str[i]] = (unsigned char)i;
+        indexes[(unsigned char)str[j]] = (unsigned char)j;
+    }
 }
 
-static ERL_NIF_TERM hashids_estimate_encoded_size_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+// Builds the per number shuffle salt: lottery + salt + alphabet cut to the alphabet length
+static void ehashids_iteration_salt(const hashids_t *hashids, char *out, char lottery, const char *alphabet)
 {
-    hashids_t **hashids = NULL;
-    ERL_NIF_TERM head;
-    ERL_NIF_TERM tail;
-    ERL_NIF_TERM tmp;
-    unsigned int len;
-    ErlNifUInt64 *numbers;
-    size_t res;
+    size_t alphabet_length = hashids->alphabet_length;
+    size_t salt_length = hashids->salt_length;
 
-    assert(sizeof(unsigned long long) == sizeof(ErlNifUInt64));
+    out[0] = lottery;
+    if(salt_length > alphabet_length - 1) salt_length = alphabet_length - 1;
+    (void)memcpy(out + 1, hashids->salt, salt_length);
+    (void)memcpy(out + 1 + salt_length, alphabet, alphabet_length - 1 - salt_length);
+}
 
-    if(EHASHIDS_UNLIKELY(argc != 2)) return make_error_tuple_from_string(env, "arity");
+/*
+ * Sets alphabet, and indexes unless it is NULL, to their state after the
+ * first shuffle of an id, from the precomputed shuffles when the context has
+ * them. salt is scratch space.
+ */
+static void ehashids_first_shuffle(const ehashids_t *ctx, char *alphabet, char *salt, char lottery, unsigned char *indexes)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    const ehashids_shuffles_t *shuffles = __atomic_load_n(&ctx->shuffles, __ATOMIC_ACQUIRE);
+    size_t alphabet_length = hashids->alphabet_length;
+    size_t row = ctx->indexes[(unsigned char)lottery];
 
-    if(EHASHIDS_UNLIKELY(!enif_get_resource(env, argv[0], hashids_type, (void **)&hashids))) {
-        return make_error_tuple_from_string(env, "bad_resource");
+    if(shuffles != NULL){
+        (void)memcpy(alphabet, shuffles->alphabets + row * alphabet_length, alphabet_length);
+        if(indexes) (void)memcpy(indexes, shuffles->indexes + row * 256, 256);
+        return;
     }
 
-    if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, argv[1], &len))){
-        return make_error_tuple_from_string(env, "numbers");
+    (void)memcpy(alphabet, hashids->alphabet, alphabet_length);
+    ehashids_iteration_salt(hashids, salt, lottery, alphabet);
+    if(indexes){
+        (void)memcpy(indexes, ctx->indexes, 256);
+        ehashids_shuffle_indexed(alphabet, alphabet_length, salt, alphabet_length, indexes);
+    } else {
+        ehashids_shuffle(alphabet, alphabet_length, salt, alphabet_length);
     }
+}
 
-    // +1 if the list is empty because we don't want strange behaviour here
-    numbers = (ErlNifUInt64 *)enif_alloc(sizeof(ErlNifUInt64) * (len + 1));
-    if(EHASHIDS_UNLIKELY(!numbers)){
-        return make_error_tuple_from_string(env, "alloc");
+/*
+ * Adds the guards and alphabet padding needed to reach min_hash_length.
+ * Every wrap shuffles alphabet with itself, when the alphabets of the first
+ * wraps_count wraps are already known they are taken from wraps instead.
+ */
+static size_t ehashids_pad(const hashids_t *hashids, char *buffer, size_t len, unsigned long long numbers_hash, char *alphabet, char *scratch, const char *wraps, size_t wraps_count)
+{
+    size_t alphabet_length = hashids->alphabet_length;
+    size_t min_hash_length = hashids->min_hash_length;
+    size_t half = alphabet_length / 2;
+    size_t excess, left, right;
+    size_t wrap;
+
+    (void)memmove(buffer + 1, buffer, len);
+    buffer[0] = hashids->guards[(numbers_hash + buffer[1]) % hashids->guards_count];
+    len++;
+
+    if(len < min_hash_length){
+        buffer[len] = hashids->guards[(numbers_hash + buffer[2]) % hashids->guards_count];
+        len++;
     }
 
-    tmp = argv[1];
-    for(unsigned int i = 0; i < len; i++, tmp = tail){
-        if(EHASHIDS_UNLIKELY(!enif_get_list_cell(env, tmp, &head, &tail))){
-            enif_free(numbers);
-            return make_error_tuple_from_string(env, "numbers");
-        }
-        if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, head, numbers + i))){
-            enif_free(numbers);
-            return make_error_tuple_from_string(env, "numbers");
+    for(wrap = 0; len < min_hash_length; wrap++){
+        if(wrap < wraps_count){
+            (void)memcpy(alphabet, wraps + wrap * alphabet_length, alphabet_length);
+        } else {
+            (void)memcpy(scratch, alphabet, alphabet_length);
+            ehashids_shuffle(alphabet, alphabet_length, scratch, alphabet_length);
         }
+
+        // wrap with the two alphabet halves and keep the centered min_hash_length characters
+        excess = len + alphabet_length > min_hash_length ? len + alphabet_length - min_hash_length : 0;
+        left = alphabet_length - half - excess / 2;
+        right = half - (excess - excess / 2);
+
+        (void)memmove(buffer + left, buffer, len);
+        (void)memcpy(buffer, alphabet + half + excess / 2, left);
+        (void)memcpy(buffer + left + len, alphabet, right);
+        len += left + right;
     }
 
-    res = hashids_estimate_encoded_size(*hashids, (size_t)len, (unsigned long long *)numbers);
-    enif_free(numbers);
-    return enif_make_tuple2(env, make_atom(env, "ok"), enif_make_uint64(env, res));
+    return len;
 }
 
-static ERL_NIF_TERM hashids_encode_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+// Same output as hashids_encode() but returns the length and does not NUL terminate
+static size_t ehashids_encode(const ehashids_t *ctx, char *buffer, size_t numbers_count, const unsigned long long *numbers)
 {
-    hashids_t **hashids = NULL;
-    ERL_NIF_TERM head;
-    ERL_NIF_TERM tail;
-    ERL_NIF_TERM tmp;
-    unsigned int len;
-    ErlNifUInt64 *numbers;
-    size_t res;
-    size_t buffer_size;
-    ErlNifBinary out_bin;
-    ERL_NIF_TERM final_bin;
+    const hashids_t *hashids = &ctx->hashids;
+    char alphabet[EHASHIDS_MAX_ALPHABET];
+    char salt[EHASHIDS_MAX_ALPHABET];
+    size_t alphabet_length = hashids->alphabet_length;
+    unsigned long long numbers_hash;
+    unsigned long long number;
+    char *start;
+    char *end;
+    char *left;
+    char *right;
+    char lottery;
+    char temp;
+    size_t i;
 
-    assert(sizeof(unsigned long long) == sizeof(ErlNifUInt64));
-
-    if(EHASHIDS_UNLIKELY(argc != 2)) return make_error_tuple_from_string(env, "arity");
+    if(EHASHIDS_UNLIKELY(numbers_count == 0)) return 0;
 
-    if(EHASHIDS_UNLIKELY(!enif_get_resource(env, argv[0], hashids_type, (void **)&hashids))) {
-        return make_error_tuple_from_string(env, "bad_resource");
+    for(i = 0, numbers_hash = 0; i < numbers_count; i++){
+        numbers_hash += numbers[i] % (i + 100);
     }
 
-    if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, argv[1], &len))){
-        return make_error_tuple_from_string(env, "numbers");
-    }
+    lottery = hashids->alphabet[numbers_hash % alphabet_length];
+    buffer[0] = lottery;
+    end = buffer + 1;
 
-    // +1 if the list is empty because we don't want strange behaviour here
-    numbers = (ErlNifUInt64 *)enif_alloc(sizeof(ErlNifUInt64) * (len + 1));
-    if(EHASHIDS_UNLIKELY(!numbers)){
-        return make_error_tuple_from_string(env, "alloc");
-    }
+    for(i = 0; i < numbers_count; i++){
+        number = numbers[i];
 
-    tmp = argv[1];
-    for(unsigned int i = 0; i < len; i++, tmp = tail){
-        if(EHASHIDS_UNLIKELY(!enif_get_list_cell(env, tmp, &head, &tail))){
-            enif_free(numbers);
-            return make_error_tuple_from_string(env, "numbers");
+        if(i == 0){
+            ehashids_first_shuffle(ctx, alphabet, salt, lottery, NULL);
+        } else {
+            ehashids_iteration_salt(hashids, salt, lottery, alphabet);
+            ehashids_shuffle(alphabet, alphabet_length, salt, alphabet_length);
         }
-        if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, head, numbers + i))){
-            enif_free(numbers);
-            return make_error_tuple_from_string(env, "numbers");
+
+        start = end;
+        do {
+            *end++ = alphabet[number % alphabet_length];
+            number /= alphabet_length;
+        } while(number);
+
+        // digits come out least significant first
+        for(left = start, right = end - 1; left < right; left++, right--){
+            temp = *left;
+            *left = *right;
+            *right = temp;
+        }
+
+        if(i + 1 < numbers_count){
+            number = numbers[i] % (start[0] + i);
+            *end++ = hashids->separators[number % hashids->separators_count];
         }
-    }
-    buffer_size = hashids_estimate_encoded_size(*hashids, (size_t)len, (unsigned long long *)numbers);
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(buffer_size, &out_bin) == 0)){
-        enif_free(numbers);
-        return make_error_tuple_from_string(env, "alloc");
     }
 
-    res = hashids_encode(*hashids, (char *)out_bin.data, (size_t)len, (unsigned long long *)numbers);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        enif_free(numbers);
-        enif_release_binary(&out_bin);
-        return make_error_tuple_from_string(env, "numbers");
+    if((size_t)(end - buffer) < hashids->min_hash_length){
+        return ehashids_pad(hashids, buffer, (size_t)(end - buffer), numbers_hash, alphabet, salt, NULL, 0);
     }
 
-    // Fix up because C gives us zero terminated strings and Erlang does not
-    out_bin.size = strlen((char *)out_bin.data);
-    final_bin = enif_make_binary(env, &out_bin);
-    enif_free(numbers);
-    return enif_make_tuple2(env, make_atom(env, "ok"), final_bin);
+    return (size_t)(end - buffer);
 }
 
-static ERL_NIF_TERM hashids_decode_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+// ehashids_encode() for a single number, with no numbers array or separators
+static size_t ehashids_encode_one(const ehashids_t *ctx, char *buffer, unsigned long long number)
 {
-    hashids_t **hashids = NULL;
-    size_t ret;
-    int res;
-    char *encoded_id = NULL;
-    ErlNifBinary encoded_id_bin;
-    unsigned long long *numbers;
-    size_t numbers_len = 8;
-    ERL_NIF_TERM *arr = NULL;
-    ERL_NIF_TERM result;
+    const hashids_t *hashids = &ctx->hashids;
+    char alphabet[EHASHIDS_MAX_ALPHABET];
+    char salt[EHASHIDS_MAX_ALPHABET];
+    char digits[64];
+    size_t alphabet_length = hashids->alphabet_length;
+    unsigned long long numbers_hash = number % 100;
+    char *p = digits + sizeof(digits);
+    size_t len;
 
-    if(EHASHIDS_UNLIKELY(argc != 2)) return make_error_tuple_from_string(env, "arity");
+    buffer[0] = hashids->alphabet[numbers_hash % alphabet_length];
+    ehashids_first_shuffle(ctx, alphabet, salt, buffer[0], NULL);
 
-    if(EHASHIDS_UNLIKELY(!enif_get_resource(env, argv[0], hashids_type, (void **)&hashids))) {
-        return make_error_tuple_from_string(env, "bad_resource");
-    }
+    // most significant digit last, so fill from the end
+    do {
+        *--p = alphabet[number % alphabet_length];
+        number /= alphabet_length;
+    } while(number);
 
-    res = enif_inspect_binary(env, argv[1], &encoded_id_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        return make_error_tuple_from_string(env, "id");
-    }
-    encoded_id = (char *)enif_alloc(encoded_id_bin.size + 1);
-    if(EHASHIDS_UNLIKELY(encoded_id == NULL)){
-        return make_error_tuple_from_string(env, "alloc");
+    len = (size_t)(digits + sizeof(digits) - p);
+    (void)memcpy(buffer + 1, p, len);
+    len++;
+
+    if(len < hashids->min_hash_length){
+        return ehashids_pad(hashids, buffer, len, numbers_hash, alphabet, salt, NULL, 0);
     }
-    (void)memcpy(encoded_id, encoded_id_bin.data, encoded_id_bin.size);
-    encoded_id[encoded_id_bin.size] = '\0';
 
-    do {
-        numbers = (unsigned long long *)enif_alloc(numbers_len * sizeof(unsigned long long));
-        ret = hashids_decode(*hashids, encoded_id, numbers, numbers_len);
-        if(EHASHIDS_UNLIKELY(ret == 0)){
-            switch(hashids_errno){
-                case HASHIDS_ERROR_INVALID_HASH:
-                    enif_free(encoded_id);
-                    enif_free(numbers);
-                    return make_error_tuple_from_string(env, "invalid_hash");
-                case HASHIDS_ERROR_ALLOC:
-                    enif_free(encoded_id);
-                    enif_free(numbers);
-                    return make_error_tuple_from_string(env, "alloc");
-                default:
-                    enif_free(encoded_id);
-                    enif_free(numbers);
-                    return make_error_tuple_from_string(env, "unknown");
-            }
-        }
-        if(EHASHIDS_UNLIKELY(ret == numbers_len && numbers_len <= EHASHIDS_MAX_NUMBERS)){
-            enif_free(numbers);
-            numbers_len <<= 1;
-        } else break;
-    }while(1);
+    return len;
+}
+
+/*
+ * Checks that every byte of an id belongs to the alphabet, the separators or
+ * the guards, so junk is rejected before any decoding. The vector versions
+ * look up 16 or 32 bytes at a time in the context bitmap: the low nibble of
+ * a byte selects a bitmap row and the high nibble a bit in that row, bytes
+ * of 128 and above select no bit at all. Returns 1 when the id is valid.
+ */
+static int ehashids_valid_scalar(const ehashids_t *ctx, const unsigned char *p, size_t len)
+{
+    const unsigned char *stop = p + len;
 
-    arr = (ERL_NIF_TERM *)enif_alloc(sizeof(ERL_NIF_TERM) * ret);
-    for(size_t i = 0; i < ret; i++){
-        arr[i] = enif_make_uint64(env, (ErlNifUInt64)numbers[i]);
+    for(; p < stop; p++){
+        if(ctx->classes[*p] == EHASHIDS_CLASS_INVALID) return 0;
     }
-    enif_free(numbers);
-    result = enif_make_list_from_array(env, arr, (unsigned int)ret);
-    enif_free(arr);
-    return enif_make_tuple2(env, make_atom(env, "ok"), result);
+
+    return 1;
 }
 
-static ERL_NIF_TERM hashids_new_from_compiled_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+#ifdef EHASHIDS_SIMD_X86
+__attribute__((target("ssse3")))
+static int ehashids_valid_ssse3(const ehashids_t *ctx, const unsigned char *p, size_t len)
 {
-    hashids_t *hashids;
-    hashids_t **resource_ref;
-    ERL_NIF_TERM resource;
-    ErlNifBinary alphabet_bin;
-    ErlNifBinary alphabet_copy1_bin;
-    ErlNifBinary alphabet_copy2_bin;
-    ErlNifBinary salt_bin;
-    ErlNifBinary separators_bin;
-    ErlNifBinary guards_bin;
-    const ERL_NIF_TERM *arr;
-    int arity;
-    int res;
-    ErlNifUInt64 alphabet_length;
-    ErlNifUInt64 salt_length;
-    ErlNifUInt64 separators_count;
-    ErlNifUInt64 guards_count;
-    ErlNifUInt64 min_hash_length;
+    const __m128i bitmap = _mm_loadu_si128((const __m128i *)ctx->bitmap);
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i chunk;
+    __m128i found;
+    size_t i;
 
-    if(EHASHIDS_UNLIKELY(argc != 1)) return make_error_tuple_from_string(env, "arity");
-    hashids = (hashids_t *)calloc(1, sizeof(hashids_t));
-
-    if(EHASHIDS_UNLIKELY(enif_get_tuple(env, argv[0], &arity, &arr) == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
+    for(i = 0; i + 16 <= len; i += 16){
+        chunk = _mm_loadu_si128((const __m128i *)(p + i));
+        found = _mm_and_si128(
+            _mm_shuffle_epi8(bitmap, _mm_and_si128(chunk, nibble)),
+            _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble))
+        );
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(found, zero)) != 0) return 0;
     }
 
-    if(EHASHIDS_UNLIKELY(arity != 11)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
+    return ehashids_valid_scalar(ctx, p + i, len - i);
+}
 
-    res = enif_inspect_binary(env, arr[0], &alphabet_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
+__attribute__((target("avx2")))
+static int ehashids_valid_avx2(const ehashids_t *ctx, const unsigned char *p, size_t len)
+{
+    const __m256i bitmap = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ctx->bitmap));
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i chunk;
+    __m256i found;
+    size_t i;
 
-    res = enif_inspect_binary(env, arr[1], &alphabet_copy1_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
+    for(i = 0; i + 32 <= len; i += 32){
+        chunk = _mm256_loadu_si256((const __m256i *)(p + i));
+        found = _mm256_and_si256(
+            _mm256_shuffle_epi8(bitmap, _mm256_and_si256(chunk, nibble)),
+            _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble))
+        );
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(found, zero)) != 0) return 0;
     }
 
-    res = enif_inspect_binary(env, arr[2], &alphabet_copy2_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
+    return ehashids_valid_ssse3(ctx, p + i, len - i);
+}
+#endif
 
-    res = enif_get_uint64(env, arr[3], &alphabet_length);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
-    hashids->alphabet_length = (size_t)alphabet_length;
+static int (*ehashids_valid_vector)(const ehashids_t *, const unsigned char *, size_t) = ehashids_valid_scalar;
 
-    res = enif_inspect_binary(env, arr[4], &salt_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
+// Picks the widest vector version the CPU supports, called on load
+static void ehashids_valid_select(void)
+{
+    ehashids_valid_vector = ehashids_valid_scalar;
+#ifdef EHASHIDS_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) ehashids_valid_vector = ehashids_valid_avx2;
+    else if(__builtin_cpu_supports("ssse3")) ehashids_valid_vector = ehashids_valid_ssse3;
+#endif
+}
 
-    res = enif_get_uint64(env, arr[5], &salt_length);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
-    hashids->salt_length = (size_t)salt_length;
+static int ehashids_valid(const ehashids_t *ctx, const unsigned char *p, size_t len)
+{
+    if(EHASHIDS_UNLIKELY(!ctx->ascii)) return ehashids_valid_scalar(ctx, p, len);
 
-    res = enif_inspect_binary(env, arr[6], &separators_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
+    return ehashids_valid_vector(ctx, p, len);
+}
 
-    res = enif_get_uint64(env, arr[7], &separators_count);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
-    hashids->separators_count = (size_t)separators_count;
+/*
+ * Finds the part of an id that holds the numbers and counts them without
+ * decoding anything. Padded ids carry the numbers between their first two
+ * guards. Returns 0 for an invalid hash.
+ */
+static size_t ehashids_numbers_count(const ehashids_t *ctx, const char *str, size_t len, const char **start, const char **end)
+{
+    const unsigned char *stop = (const unsigned char *)str + len;
+    const unsigned char *first_guard = NULL;
+    const unsigned char *second_guard = NULL;
+    const unsigned char *p;
+    size_t guards = 0;
+    size_t count = 1;
 
-    res = enif_inspect_binary(env, arr[8], &guards_bin);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
+    for(p = (const unsigned char *)str; p < stop; p++){
+        if(ctx->classes[*p] == EHASHIDS_CLASS_GUARD){
+            if(guards == 0) first_guard = p;
+            else if(guards == 1) second_guard = p;
+            guards++;
+        }
     }
 
-    res = enif_get_uint64(env, arr[9], &guards_count);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
+    if(guards == 1 || guards == 2){
+        *start = (const char *)first_guard + 1;
+        *end = (const char *)(second_guard ? second_guard : stop);
+    } else {
+        *start = str;
+        *end = (const char *)(guards ? first_guard : stop);
     }
-    hashids->guards_count = (size_t)guards_count;
 
-    res = enif_get_uint64(env, arr[10], &min_hash_length);
-    if(EHASHIDS_UNLIKELY(res == 0)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "badarg");
-    }
-    hashids->min_hash_length = (size_t)min_hash_length;
+    if(EHASHIDS_UNLIKELY(*start == *end)) return 0;
 
-    hashids->alphabet = (char *)calloc(1, alphabet_bin.size);
-    if(EHASHIDS_UNLIKELY(hashids->alphabet == NULL)){
-        free(hashids);
-        return make_error_tuple_from_string(env, "alloc");
-    }
+    // the lottery character comes first
+    if(EHASHIDS_UNLIKELY(ctx->classes[(unsigned char)**start] != EHASHIDS_CLASS_ALPHABET)) return 0;
 
-    hashids->alphabet_copy_1 = (char *)calloc(1, alphabet_copy1_bin.size);
-    if(EHASHIDS_UNLIKELY(hashids->alphabet_copy_1 == NULL)){
-        free(hashids->alphabet);
-        free(hashids);
-        return make_error_tuple_from_string(env, "alloc");
+    for(p = (const unsigned char *)*start + 1; p < (const unsigned char *)*end; p++){
+        switch(ctx->classes[*p]){
+            case EHASHIDS_CLASS_ALPHABET:
+                break;
+            case EHASHIDS_CLASS_SEPARATOR:
+                count++;
+                break;
+            default:
+                return 0;
+        }
     }
 
-    hashids->alphabet_copy_2 = (char *)calloc(1, alphabet_copy2_bin.size);
-    if(EHASHIDS_UNLIKELY(hashids->alphabet_copy_2 == NULL)){
-        free(hashids->alphabet_copy_1);
-        free(hashids->alphabet);
-        free(hashids);
-        return make_error_tuple_from_string(env, "alloc");
-    }
+    return count;
+}
 
-    hashids->salt = (char *)calloc(1, salt_bin.size);
-    if(EHASHIDS_UNLIKELY(hashids->salt == NULL)){
-        free(hashids->alphabet_copy_2);
-        free(hashids->alphabet_copy_1);
-        free(hashids->alphabet);
-        free(hashids);
-        return make_error_tuple_from_string(env, "alloc");
-    }
+/*
+ * Decodes the part found by ehashids_numbers_count(), numbers must have room
+ * for all of them. Returns 0 when a number may not fit in 64 bits, the id then
+ * has to go through ehashids_decode_big().
+ */
+static int ehashids_decode(const ehashids_t *ctx, const char *start, const char *end, unsigned long long *numbers)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    char alphabet[EHASHIDS_MAX_ALPHABET];
+    char salt[EHASHIDS_MAX_ALPHABET];
+    unsigned char indexes[256];
+    size_t alphabet_length = hashids->alphabet_length;
+    const unsigned char *p;
+    unsigned long long number = 0;
+    unsigned long long limit = (ULLONG_MAX - (alphabet_length - 1)) / alphabet_length;
+    int fits = 1;
+    char lottery;
 
-    hashids->separators = (char *)calloc(1, separators_bin.size);
-    if(EHASHIDS_UNLIKELY(hashids->separators == NULL)){
-        free(hashids->salt);
-        free(hashids->alphabet_copy_2);
-        free(hashids->alphabet_copy_1);
-        free(hashids->alphabet);
-        free(hashids);
-        return make_error_tuple_from_string(env, "alloc");
-    }
+    lottery = *start++;
 
-    hashids->guards = (char *)calloc(1, guards_bin.size);
-    if(EHASHIDS_UNLIKELY(hashids->guards == NULL)){
-        free(hashids->separators);
-        free(hashids->salt);
-        free(hashids->alphabet_copy_2);
-        free(hashids->alphabet_copy_1);
-        free(hashids->alphabet);
-        free(hashids);
-        return make_error_tuple_from_string(env, "alloc");
-    }
+    ehashids_first_shuffle(ctx, alphabet, salt, lottery, indexes);
 
-    (void)memcpy(hashids->alphabet, alphabet_bin.data, alphabet_bin.size);
-    (void)memcpy(hashids->alphabet_copy_1, alphabet_copy1_bin.data, alphabet_copy1_bin.size);
-    (void)memcpy(hashids->alphabet_copy_2, alphabet_copy2_bin.data, alphabet_copy2_bin.size);
-    (void)memcpy(hashids->salt, salt_bin.data, salt_bin.size);
-    (void)memcpy(hashids->separators, separators_bin.data, separators_bin.size);
-    (void)memcpy(hashids->guards, guards_bin.data, guards_bin.size);
+    // ehashids_numbers_count() already checked every character is in the alphabet or a separator
+    for(p = (const unsigned char *)start;; p++){
+        if(p == (const unsigned char *)end || ctx->classes[*p] == EHASHIDS_CLASS_SEPARATOR){
+            *numbers++ = number;
+            if(p == (const unsigned char *)end) break;
 
-    resource_ref = (hashids_t **)enif_alloc_resource(hashids_type, sizeof(hashids_t *));
-    *resource_ref = hashids;
+            number = 0;
+            ehashids_iteration_salt(hashids, salt, lottery, alphabet);
+            ehashids_shuffle_indexed(alphabet, alphabet_length, salt, alphabet_length, indexes);
+            continue;
+        }
 
-    resource = enif_make_resource(env, resource_ref);
-    enif_release_resource(resource_ref);
+        if(EHASHIDS_UNLIKELY(number > limit)) fits = 0;
+        number = number * alphabet_length + indexes[*p];
+    }
 
-    return resource;
+    return fits;
 }
 
-static ERL_NIF_TERM hashids_compile_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// Builds the lookup tables of a context, returns 0 if a character is used twice
+static int ehashids_build_tables(ehashids_t *ctx)
 {
-    hashids_t **hashids = NULL;
-    hashids_t *h;
-    ErlNifBinary alphabet_bin;
-    ERL_NIF_TERM alphabet_final_bin;
-    ErlNifBinary alphabet_copy1_bin;
-    ERL_NIF_TERM alphabet_copy1_final_bin;
-    ErlNifBinary alphabet_copy2_bin;
-    ERL_NIF_TERM alphabet_copy2_final_bin;
-    size_t alphabet_length;
-    ErlNifBinary salt_bin;
-    ERL_NIF_TERM salt_final_bin;
-    size_t salt_length;
-    ErlNifBinary separators_bin;
-    ERL_NIF_TERM separators_final_bin;
-    size_t separators_count;
-    ErlNifBinary guards_bin;
-    ERL_NIF_TERM guards_final_bin;
-    size_t guards_count;
-    size_t min_hash_length;
-    ERL_NIF_TERM arr[11];
+    const hashids_t *hashids = &ctx->hashids;
+    size_t i;
+
+    (void)memset(ctx->classes, EHASHIDS_CLASS_INVALID, sizeof(ctx->classes));
+    (void)memset(ctx->indexes, 0, sizeof(ctx->indexes));
 
-    if(EHASHIDS_UNLIKELY(argc != 1)) return make_error_tuple_from_string(env, "arity");
+    for(i = 0; i < hashids->alphabet_length; i++){
+        if(ctx->classes[(unsigned char)hashids->alphabet[i]] != EHASHIDS_CLASS_INVALID) return 0;
+        ctx->classes[(unsigned char)hashids->alphabet[i]] = EHASHIDS_CLASS_ALPHABET;
+        ctx->indexes[(unsigned char)hashids->alphabet[i]] = (unsigned char)i;
+    }
+    for(i = 0; i < hashids->separators_count; i++){
+        if(ctx->classes[(unsigned char)hashids->separators[i]] != EHASHIDS_CLASS_INVALID) return 0;
+        ctx->classes[(unsigned char)hashids->separators[i]] = EHASHIDS_CLASS_SEPARATOR;
+    }
+    for(i = 0; i < hashids->guards_count; i++){
+        if(ctx->classes[(unsigned char)hashids->guards[i]] != EHASHIDS_CLASS_INVALID) return 0;
+        ctx->classes[(unsigned char)hashids->guards[i]] = EHASHIDS_CLASS_GUARD;
+    }
 
-    if(EHASHIDS_UNLIKELY(!enif_get_resource(env, argv[0], hashids_type, (void **)&hashids))) {
-        return make_error_tuple_from_string(env, "bad_resource");
+    (void)memset(ctx->bitmap, 0, sizeof(ctx->bitmap));
+    ctx->ascii = 1;
+    for(i = 0; i < 256; i++){
+        if(ctx->classes[i] == EHASHIDS_CLASS_INVALID) continue;
+        if(i >= 128) ctx->ascii = 0;
+        else ctx->bitmap[i & 15] |= (unsigned char)(1 << (i >> 4));
     }
 
-    h = *hashids;
+    return 1;
+}
 
-    alphabet_length = h->alphabet_length;
-    salt_length = h->salt_length;
-    separators_count = h->separators_count;
-    guards_count = h->guards_count;
-    min_hash_length = h->min_hash_length;
+// Copies len bytes of src to data as a NUL terminated string, returns the next free byte
+static char *ehashids_place_string(char **field, char *data, const char *src, size_t len)
+{
+    (void)memcpy(data, src, len);
+    data[len] = '\0';
+    *field = data;
+    return data + len + 1;
+}
 
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(alphabet_length + 1, &alphabet_bin) == 0)){
-        return make_error_tuple_from_string(env, "alloc");
-    }
-    (void)memcpy(alphabet_bin.data, h->alphabet, alphabet_length + 1);
+/*
+ * Builds the shuffles of ctx unless it already has them and publishes them
+ * with a compare and swap, a call losing the race frees its copy. Returns
+ * the shuffles of ctx or NULL when out of memory.
+ */
+static const ehashids_shuffles_t *ehashids_precompute_shuffles(ehashids_t *ctx)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    ehashids_shuffles_t *shuffles = __atomic_load_n(&ctx->shuffles, __ATOMIC_ACQUIRE);
+    ehashids_shuffles_t *expected = NULL;
+    char salt[EHASHIDS_MAX_ALPHABET];
+    size_t alphabet_length = hashids->alphabet_length;
+    size_t bytes;
+    size_t row;
 
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(alphabet_length + 1, &alphabet_copy1_bin) == 0)){
-        enif_release_binary(&alphabet_bin);
-        return make_error_tuple_from_string(env, "alloc");
-    }
-    (void)memcpy(alphabet_copy1_bin.data, h->alphabet_copy_1 , alphabet_length + 1);
+    if(shuffles != NULL) return shuffles;
 
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(alphabet_length + 1, &alphabet_copy2_bin) == 0)){
-        enif_release_binary(&alphabet_bin);
-        enif_release_binary(&alphabet_copy1_bin);
-        return make_error_tuple_from_string(env, "alloc");
-    }
-    (void)memcpy(alphabet_copy2_bin.data, h->alphabet_copy_2, alphabet_length + 1);
+    bytes = sizeof(ehashids_shuffles_t) + alphabet_length * (alphabet_length + 256);
+    shuffles = (ehashids_shuffles_t *)enif_alloc(bytes);
+    if(EHASHIDS_UNLIKELY(shuffles == NULL)) return NULL;
 
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(salt_length + 1, &salt_bin) == 0)){
-        enif_release_binary(&alphabet_bin);
-        enif_release_binary(&alphabet_copy1_bin);
-        enif_release_binary(&alphabet_copy2_bin);
-        return make_error_tuple_from_string(env, "alloc");
+    shuffles->bytes = bytes;
+    shuffles->alphabets = shuffles->data;
+    shuffles->indexes = (unsigned char *)shuffles->data + alphabet_length * alphabet_length;
+    for(row = 0; row < alphabet_length; row++){
+        ehashids_first_shuffle(ctx, shuffles->alphabets + row * alphabet_length, salt,
+                               hashids->alphabet[row], shuffles->indexes + row * 256);
     }
-    (void)memcpy(salt_bin.data, h->salt, salt_length + 1);
 
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(separators_count + 1, &separators_bin) == 0)){
-        enif_release_binary(&alphabet_bin);
-        enif_release_binary(&alphabet_copy1_bin);
-        enif_release_binary(&alphabet_copy2_bin);
-        enif_release_binary(&salt_bin);
-        return make_error_tuple_from_string(env, "alloc");
+    if(!__atomic_compare_exchange_n(&ctx->shuffles, &expected, shuffles, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        enif_free(shuffles);
+        return expected;
     }
-    (void)memcpy(separators_bin.data, h->separators, separators_count + 1);
 
-    if(EHASHIDS_UNLIKELY(enif_alloc_binary(guards_count + 1, &guards_bin) == 0)){
-        enif_release_binary(&alphabet_bin);
-        enif_release_binary(&alphabet_copy1_bin);
-        enif_release_binary(&alphabet_copy2_bin);
-        enif_release_binary(&salt_bin);
-        enif_release_binary(&separators_bin);
-        return make_error_tuple_from_string(env, "alloc");
+    return shuffles;
+}
+
+static void ehashids_decode_cache_free(ehashids_decode_cache_t *cache)
+{
+    for(int i = 0; i < EHASHIDS_STATS_STRIPES; i++){
+        if(cache->parts[i].lock != NULL) enif_mutex_destroy(cache->parts[i].lock);
     }
-    (void)memcpy(guards_bin.data, h->guards, guards_count + 1);
+    enif_free(cache);
+}
 
-    alphabet_final_bin = enif_make_binary(env, &alphabet_bin);
-    alphabet_copy1_final_bin = enif_make_binary(env, &alphabet_copy1_bin);
-    alphabet_copy2_final_bin = enif_make_binary(env, &alphabet_copy2_bin);
-    salt_final_bin = enif_make_binary(env, &salt_bin);
-    separators_final_bin = enif_make_binary(env, &separators_bin);
-    guards_final_bin = enif_make_binary(env, &guards_bin);
+/*
+ * Makes the decode cache of ctx with room for about entries ids unless it
+ * already has one and publishes it like ehashids_precompute_shuffles().
+ * Returns the decode cache of ctx or NULL when out of memory.
+ */
+static const ehashids_decode_cache_t *ehashids_enable_decode_cache(ehashids_t *ctx, size_t entries)
+{
+    ehashids_decode_cache_t *cache = __atomic_load_n(&ctx->decode_cache, __ATOMIC_ACQUIRE);
+    ehashids_decode_cache_t *expected = NULL;
+    size_t per_part = (entries + EHASHIDS_STATS_STRIPES - 1) / EHASHIDS_STATS_STRIPES;
+    size_t sets = 1;
+    size_t slots_bytes;
+    size_t bytes;
+    char *data;
 
-    arr[0] = alphabet_final_bin;
-    arr[1] = alphabet_copy1_final_bin;
-    arr[2] = alphabet_copy2_final_bin;
-    arr[3] = enif_make_uint64(env, (uint64_t)alphabet_length);
-    arr[4] = salt_final_bin;
-    arr[5] = enif_make_uint64(env, (uint64_t)salt_length);
-    arr[6] = separators_final_bin;
-    arr[7] = enif_make_uint64(env, (uint64_t)separators_count);
-    arr[8] = guards_final_bin;
-    arr[9] = enif_make_uint64(env, (uint64_t)guards_count);
-    arr[10] = enif_make_uint64(env, (uint64_t)min_hash_length);
+    if(cache != NULL) return cache;
 
-    return enif_make_tuple2(
-        env,
-        make_atom(env, "ok"),
-        enif_make_tuple_from_array(env, arr, 11)
+    while(sets * EHASHIDS_DECODE_CACHE_WAYS < per_part) sets <<= 1;
+    slots_bytes = sizeof(ehashids_decoded_t) * sets * EHASHIDS_DECODE_CACHE_WAYS;
+    bytes = sizeof(ehashids_decode_cache_t) + EHASHIDS_CACHE_LINE - 1 + EHASHIDS_STATS_STRIPES * (slots_bytes + sets);
+    cache = (ehashids_decode_cache_t *)enif_alloc(bytes);
+    if(EHASHIDS_UNLIKELY(cache == NULL)) return NULL;
+
+    (void)memset(cache, 0, bytes);
+    cache->bytes = bytes;
+    cache->sets = sets;
+    data = (char *)(((uintptr_t)cache->data + EHASHIDS_CACHE_LINE - 1) & ~(uintptr_t)(EHASHIDS_CACHE_LINE - 1));
+    for(int i = 0; i < EHASHIDS_STATS_STRIPES; i++){
+        cache->parts[i].lock = enif_mutex_create("ehashids_decode_cache");
+        if(EHASHIDS_UNLIKELY(cache->parts[i].lock == NULL)){
+            ehashids_decode_cache_free(cache);
+            return NULL;
+        }
+        cache->parts[i].slots = (ehashids_decoded_t *)data;
+        data += slots_bytes;
+    }
+    for(int i = 0; i < EHASHIDS_STATS_STRIPES; i++){
+        cache->parts[i].hands = (unsigned char *)data;
+        data += sets;
+    }
+
+    if(!__atomic_compare_exchange_n(&ctx->decode_cache, &expected, cache, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        ehashids_decode_cache_free(cache);
+        return expected;
+    }
+
+    return cache;
+}
+
+// FNV-1a over the id
+static uint64_t ehashids_decode_cache_hash(const ErlNifBinary *id_bin)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for(size_t i = 0; i < id_bin->size; i++){
+        hash = (hash ^ id_bin->data[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static ehashids_decoded_t *ehashids_decode_cache_set(ehashids_decode_part_t *part, const ehashids_decode_cache_t *cache, uint64_t hash)
+{
+    return part->slots + (hash & (cache->sets - 1)) * EHASHIDS_DECODE_CACHE_WAYS;
+}
+
+// Copies the entry of the id into *out when the cache of the calling thread has it, returns whether it did
+static int ehashids_decode_cache_find(ehashids_decode_cache_t *cache, uint64_t hash, const ErlNifBinary *id_bin, ehashids_decoded_t *out)
+{
+    ehashids_decode_part_t *part = cache->parts + ehashids_stripe();
+    ehashids_decoded_t *set = ehashids_decode_cache_set(part, cache, hash);
+    int found = 0;
+
+    enif_mutex_lock(part->lock);
+    for(int i = 0; i < EHASHIDS_DECODE_CACHE_WAYS; i++){
+        if(set[i].hash == hash && set[i].id_length == id_bin->size &&
+           memcmp(set[i].id, id_bin->data, id_bin->size) == 0){
+            set[i].referenced = 1;
+            *out = set[i];
+            found = 1;
+            break;
+        }
+    }
+    enif_mutex_unlock(part->lock);
+
+    return found;
+}
+
+/*
+ * Keeps the numbers of an id in the cache of the calling thread, replacing
+ * the entry of the same id if there is one. The id must fit and count be at
+ * most EHASHIDS_DECODE_CACHE_NUMBERS. Returns 1 when another id was evicted.
+ */
+static int ehashids_decode_cache_store(ehashids_decode_cache_t *cache, uint64_t hash, const ErlNifBinary *id_bin, const unsigned long long *numbers, size_t count, int canonical)
+{
+    ehashids_decode_part_t *part = cache->parts + ehashids_stripe();
+    ehashids_decoded_t *set = ehashids_decode_cache_set(part, cache, hash);
+    unsigned char *hand = part->hands + (hash & (cache->sets - 1));
+    ehashids_decoded_t *slot = NULL;
+    int evicted = 0;
+
+    enif_mutex_lock(part->lock);
+    for(int i = 0; i < EHASHIDS_DECODE_CACHE_WAYS; i++){
+        if(set[i].id_length == 0 ||
+           (set[i].hash == hash && set[i].id_length == id_bin->size && memcmp(set[i].id, id_bin->data, id_bin->size) == 0)){
+            slot = set + i;
+            break;
+        }
+    }
+    if(slot == NULL){
+        for(;;){
+            slot = set + *hand;
+            *hand = (*hand + 1) % EHASHIDS_DECODE_CACHE_WAYS;
+            if(!slot->referenced) break;
+            slot->referenced = 0;
+        }
+        evicted = 1;
+    }
+
+    slot->hash = hash;
+    (void)memcpy(slot->numbers, numbers, sizeof(unsigned long long) * count);
+    (void)memcpy(slot->id, id_bin->data, id_bin->size);
+    slot->id_length = (unsigned char)id_bin->size;
+    slot->count = (unsigned char)count;
+    slot->canonical = (unsigned char)canonical;
+    slot->referenced = 0;
+    enif_mutex_unlock(part->lock);
+
+    return evicted;
+}
+
+static void ehashids_legacy_free(ehashids_legacy_t *legacy)
+{
+    // hashids_free() with the default allocator of hashids.c
+    free(legacy->alphabet);
+    free(legacy->alphabet_copy_1);
+    free(legacy->alphabet_copy_2);
+    free(legacy->salt);
+    free(legacy->separators);
+    free(legacy->guards);
+    free(legacy);
+}
+
+static void ehashids_context_dtor(ErlNifEnv *env, void *obj)
+{
+    ehashids_t *ctx = (ehashids_t *)obj;
+    size_t size = enif_sizeof_resource(obj);
+    uintptr_t legacy;
+
+    if(size == sizeof(ehashids_legacy_t *)){
+        legacy = *(uintptr_t *)obj;
+        if(legacy & 1){
+            enif_release_resource((void *)(legacy & ~(uintptr_t)1));
+        } else if(legacy != 0){
+            ehashids_legacy_free((ehashids_legacy_t *)legacy);
+        }
+        return;
+    }
+
+    // a layout this library does not know keeps what it owns rather than being misread
+    if(EHASHIDS_UNLIKELY(size < sizeof(ehashids_t) || ctx->magic != EHASHIDS_CONTEXT_MAGIC ||
+                         ctx->layout != EHASHIDS_LAYOUT_VERSION)){
+        return;
+    }
+
+    if(ctx->shuffles != NULL) enif_free(ctx->shuffles);
+    if(ctx->decode_cache != NULL) ehashids_decode_cache_free(ctx->decode_cache);
+}
+
+static void ehashids_keyring_dtor(ErlNifEnv *env, void *obj)
+{
+    ehashids_keyring_t *keyring = (ehashids_keyring_t *)obj;
+    size_t i;
+
+    for(i = 0; i < keyring->count; i++){
+        enif_release_resource(keyring->keys[i]);
+    }
+}
+
+/*
+ * Creates a new hashids_type resource holding a copy of the strings and
+ * lengths of source, which stays owned by the caller. The caller owns the
+ * returned reference. Returns an error reason or NULL.
+ */
+static const char *ehashids_new_context(ErlNifEnv *env, const hashids_t *source, ehashids_t **out)
+{
+    ehashids_t *ctx;
+    hashids_t *hashids;
+    size_t bytes;
+    char *data;
+
+    // the shuffles and the modulos of the encoder need at least this much
+    if(EHASHIDS_UNLIKELY(source->alphabet_length < 2 || source->alphabet_length > EHASHIDS_MAX_ALPHABET ||
+                         source->separators_count == 0 || source->guards_count == 0)){
+        return "badarg";
+    }
+
+    bytes = sizeof(ehashids_t) + EHASHIDS_CACHE_LINE - 1 + sizeof(ehashids_stats_t) +
+            source->alphabet_length + source->salt_length + source->separators_count + source->guards_count + 4;
+    ctx = (ehashids_t *)enif_alloc_resource(hashids_type, bytes);
+    if(EHASHIDS_UNLIKELY(ctx == NULL)) return "alloc";
+    ctx->magic = EHASHIDS_CONTEXT_MAGIC;
+    ctx->layout = EHASHIDS_LAYOUT_VERSION;
+    ctx->shuffles = NULL;
+    ctx->decode_cache = NULL;
+    ctx->bytes = bytes;
+
+    ctx->stats = (ehashids_stats_t *)(((uintptr_t)ctx->data + EHASHIDS_CACHE_LINE - 1) & ~(uintptr_t)(EHASHIDS_CACHE_LINE - 1));
+    (void)memset(ctx->stats, 0, sizeof(ehashids_stats_t));
+
+    hashids = &ctx->hashids;
+    data = (char *)(ctx->stats + 1);
+    data = ehashids_place_string(&hashids->alphabet, data, source->alphabet, source->alphabet_length);
+    data = ehashids_place_string(&hashids->salt, data, source->salt, source->salt_length);
+    data = ehashids_place_string(&hashids->separators, data, source->separators, source->separators_count);
+    (void)ehashids_place_string(&hashids->guards, data, source->guards, source->guards_count);
+    hashids->alphabet_length = source->alphabet_length;
+    hashids->salt_length = source->salt_length;
+    hashids->separators_count = source->separators_count;
+    hashids->guards_count = source->guards_count;
+    hashids->min_hash_length = source->min_hash_length;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_build_tables(ctx))){
+        enif_release_resource(ctx);
+        return "badarg";
+    }
+
+    if(((ehashids_priv_t *)enif_priv_data(env))->precompute &&
+       EHASHIDS_UNLIKELY(ehashids_precompute_shuffles(ctx) == NULL)){
+        enif_release_resource(ctx);
+        return "alloc";
+    }
+
+    *out = ctx;
+    return NULL;
+}
+
+// Same as ehashids_new_context() but returns the resource term
+static const char *ehashids_make_resource(ErlNifEnv *env, const hashids_t *source, ERL_NIF_TERM *out)
+{
+    ehashids_t *ctx;
+    const char *reason;
+
+    reason = ehashids_new_context(env, source, &ctx);
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return reason;
+
+    *out = enif_make_resource(env, ctx);
+    enif_release_resource(ctx);
+
+    return NULL;
+}
+
+/*
+ * Rebuilds a context of the libraries that linked hashids.c from its
+ * shuffled strings, which give the same ids, the first time it is used and
+ * keeps the result in its place. The rebuild is serialized by legacy_lock
+ * so the hashids_t is only read and freed by one thread, later calls
+ * find the rebuilt context without locking. Returns NULL when it can't be
+ * rebuilt.
+ */
+static ehashids_t *ehashids_context_of_legacy(ErlNifEnv *env, uintptr_t *obj)
+{
+    ehashids_shared_t *shared = ((ehashids_priv_t *)enif_priv_data(env))->shared;
+    ehashids_legacy_t *legacy;
+    ehashids_t *ctx;
+    hashids_t source;
+    uintptr_t current;
+
+    current = __atomic_load_n(obj, __ATOMIC_ACQUIRE);
+    if(EHASHIDS_LIKELY(current & 1)) return (ehashids_t *)(current & ~(uintptr_t)1);
+
+    enif_mutex_lock(shared->legacy_lock);
+    current = __atomic_load_n(obj, __ATOMIC_ACQUIRE);
+    if(!(current & 1) && current != 0){
+        legacy = (ehashids_legacy_t *)current;
+        source.alphabet = legacy->alphabet;
+        source.alphabet_length = legacy->alphabet_length;
+        source.salt = legacy->salt;
+        source.salt_length = legacy->salt_length;
+        source.separators = legacy->separators;
+        source.separators_count = legacy->separators_count;
+        source.guards = legacy->guards;
+        source.guards_count = legacy->guards_count;
+        source.min_hash_length = legacy->min_hash_length;
+        if(ehashids_new_context(env, &source, &ctx) == NULL){
+            current = (uintptr_t)ctx | 1;
+            __atomic_store_n(obj, current, __ATOMIC_RELEASE);
+            ehashids_legacy_free(legacy);
+        }
+    }
+    enif_mutex_unlock(shared->legacy_lock);
+
+    return (current & 1) ? (ehashids_t *)(current & ~(uintptr_t)1) : NULL;
+}
+
+/*
+ * The context of a hashids_type resource object in the layout of this
+ * library, rebuilding the ones of older layouts it knows. Returns NULL for
+ * the layouts it doesn't.
+ */
+static ehashids_t *ehashids_context_of(ErlNifEnv *env, void *obj)
+{
+    ehashids_t *ctx = (ehashids_t *)obj;
+    size_t size = enif_sizeof_resource(obj);
+
+    if(EHASHIDS_LIKELY(size >= sizeof(ehashids_t) && ctx->magic == EHASHIDS_CONTEXT_MAGIC &&
+                       ctx->layout == EHASHIDS_LAYOUT_VERSION)){
+        return ctx;
+    }
+    if(size == sizeof(ehashids_legacy_t *)) return ehashids_context_of_legacy(env, (uintptr_t *)obj);
+
+    return NULL;
+}
+
+// enif_get_resource() of a hashids_type term through ehashids_context_of()
+static int ehashids_get_context(ErlNifEnv *env, ERL_NIF_TERM term, ehashids_t **out)
+{
+    void *obj;
+
+    if(EHASHIDS_UNLIKELY(!enif_get_resource(env, term, hashids_type, &obj))) return 0;
+
+    *out = ehashids_context_of(env, obj);
+    return *out != NULL;
+}
+
+static int ehashids_cache_init(ehashids_cache_t *cache, size_t capacity)
+{
+    size_t buckets = 1;
+    size_t i;
+
+    (void)memset(cache, 0, sizeof(ehashids_cache_t));
+    cache->capacity = capacity;
+    if(capacity == 0) return 1;
+
+    // keep chains short, about one entry per two buckets
+    while(buckets < capacity * 2) buckets <<= 1;
+    cache->bucket_mask = buckets - 1;
+
+    cache->lock = enif_mutex_create("ehashids_cache");
+    cache->entries = (ehashids_cache_entry_t *)enif_alloc(sizeof(ehashids_cache_entry_t) * capacity);
+    cache->buckets = (int *)enif_alloc(sizeof(int) * buckets);
+    if(EHASHIDS_UNLIKELY(cache->lock == NULL || cache->entries == NULL || cache->buckets == NULL)){
+        ehashids_cache_free(cache);
+        return 0;
+    }
+
+    for(i = 0; i < buckets; i++) cache->buckets[i] = -1;
+
+    return 1;
+}
+
+static ehashids_shared_t *ehashids_shared_create(size_t capacity)
+{
+    ehashids_shared_t *shared;
+
+    shared = (ehashids_shared_t *)enif_alloc(sizeof(ehashids_shared_t));
+    if(EHASHIDS_UNLIKELY(shared == NULL)) return NULL;
+    (void)memset(&shared->stats, 0, sizeof(ehashids_stats_t));
+    shared->users = 1;
+
+    shared->legacy_lock = enif_mutex_create("ehashids_legacy");
+    if(EHASHIDS_UNLIKELY(shared->legacy_lock == NULL)){
+        enif_free(shared);
+        return NULL;
+    }
+
+    if(EHASHIDS_UNLIKELY(!ehashids_cache_init(&shared->cache, capacity))){
+        enif_mutex_destroy(shared->legacy_lock);
+        enif_free(shared);
+        return NULL;
+    }
+
+    return shared;
+}
+
+static void ehashids_shared_free(ehashids_shared_t *shared)
+{
+    ehashids_cache_free(&shared->cache);
+    enif_mutex_destroy(shared->legacy_lock);
+    enif_free(shared);
+}
+
+static void ehashids_cache_free(ehashids_cache_t *cache)
+{
+    size_t i;
+
+    for(i = 0; i < cache->size; i++){
+        enif_release_resource(cache->entries[i].ctx);
+        enif_free(cache->entries[i].key);
+    }
+    if(cache->entries) enif_free(cache->entries);
+    if(cache->buckets) enif_free(cache->buckets);
+    if(cache->lock) enif_mutex_destroy(cache->lock);
+    (void)memset(cache, 0, sizeof(ehashids_cache_t));
+}
+
+// FNV-1a over the parameters of new/*
+static uint64_t ehashids_cache_hash(const ErlNifBinary *salt, unsigned int min_hash_length, const ErlNifBinary *alphabet)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for(i = 0; i < salt->size; i++){
+        hash = (hash ^ salt->data[i]) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ salt->size) * 0x100000001b3ULL;
+    hash = (hash ^ min_hash_length) * 0x100000001b3ULL;
+    for(i = 0; i < alphabet->size; i++){
+        hash = (hash ^ alphabet->data[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+// Finds the context for the given parameters, the cache must be locked
+static ehashids_t *ehashids_cache_find(ehashids_cache_t *cache, uint64_t hash, const ErlNifBinary *salt, unsigned int min_hash_length, const ErlNifBinary *alphabet)
+{
+    ehashids_cache_entry_t *entry;
+    int index;
+
+    for(index = cache->buckets[hash & cache->bucket_mask]; index >= 0; index = entry->next){
+        entry = cache->entries + index;
+        if(entry->hash == hash &&
+           entry->min_hash_length == min_hash_length &&
+           entry->salt_size == salt->size &&
+           entry->alphabet_size == alphabet->size &&
+           memcmp(entry->key, salt->data, salt->size) == 0 &&
+           memcmp(entry->key + salt->size, alphabet->data, alphabet->size) == 0){
+            entry->referenced = 1;
+            return entry->ctx;
+        }
+    }
+
+    return NULL;
+}
+
+// Picks the slot for a new entry, evicting the first entry not used since the hand last passed it
+static ehashids_cache_entry_t *ehashids_cache_slot(ehashids_cache_t *cache)
+{
+    ehashids_cache_entry_t *entry;
+    int *link;
+
+    if(cache->size < cache->capacity) return cache->entries + cache->size++;
+
+    for(;;){
+        entry = cache->entries + cache->hand;
+        cache->hand = (cache->hand + 1) % cache->capacity;
+        if(!entry->referenced) break;
+        entry->referenced = 0;
+    }
+
+    for(link = cache->buckets + (entry->hash & cache->bucket_mask); *link != entry - cache->entries; link = &cache->entries[*link].next);
+    *link = entry->next;
+
+    enif_release_resource(entry->ctx);
+    enif_free(entry->key);
+    cache->evictions++;
+
+    return entry;
+}
+
+/*
+ * Adds a context to the cache, the cache must be locked. The cache keeps its
+ * own reference to ctx. Nothing is added when the key cannot be copied, the
+ * context is still usable, just not shared.
+ */
+static void ehashids_cache_insert(ehashids_cache_t *cache, uint64_t hash, const ErlNifBinary *salt, unsigned int min_hash_length, const ErlNifBinary *alphabet, ehashids_t *ctx)
+{
+    ehashids_cache_entry_t *entry;
+    char *key;
+
+    key = (char *)enif_alloc(salt->size + alphabet->size + 1);
+    if(EHASHIDS_UNLIKELY(key == NULL)) return;
+    (void)memcpy(key, salt->data, salt->size);
+    (void)memcpy(key + salt->size, alphabet->data, alphabet->size);
+
+    entry = ehashids_cache_slot(cache);
+    entry->hash = hash;
+    entry->ctx = ctx;
+    entry->key = key;
+    entry->salt_size = salt->size;
+    entry->alphabet_size = alphabet->size;
+    entry->min_hash_length = min_hash_length;
+    entry->referenced = 0;
+    entry->next = cache->buckets[hash & cache->bucket_mask];
+    cache->buckets[hash & cache->bucket_mask] = (int)(entry - cache->entries);
+
+    enif_keep_resource(ctx);
+}
+
+// CRC-32 as computed by erlang:crc32/1, a nibble at a time
+static uint32_t ehashids_crc32(const unsigned char *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    uint32_t crc = 0xFFFFFFFF;
+
+    while(len--){
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+
+    return ~crc;
+}
+
+static void ehashids_put_le(unsigned char *out, uint32_t value, size_t bytes)
+{
+    size_t i;
+
+    for(i = 0; i < bytes; i++, value >>= 8){
+        out[i] = (unsigned char)(value & 0xFF);
+    }
+}
+
+static uint32_t ehashids_get_le(const unsigned char *in, size_t bytes)
+{
+    uint32_t value = 0;
+
+    while(bytes--){
+        value = (value << 8) | in[bytes];
+    }
+
+    return value;
+}
+
+/*
+ * The compile/1 format, all integers little endian:
+ *
+ *   0  "EHID"
+ *   4  version (1 byte)
+ *   5  reserved, 0 (1 byte)
+ *   6  alphabet length (2 bytes)
+ *   8  separators count (2 bytes)
+ *   10 guards count (2 bytes)
+ *   12 salt length (4 bytes)
+ *   16 min hash length (4 bytes)
+ *   20 alphabet, salt, separators and guards without terminators
+ *   .. CRC-32 of everything before it (4 bytes)
+ *
+ * Unpacking points source into the binary without copying anything.
+ */
+static const char *ehashids_unpack(const ErlNifBinary *compiled_bin, hashids_t *source)
+{
+    const unsigned char *data = compiled_bin->data;
+    size_t size = compiled_bin->size;
+    const unsigned char *p;
+
+    if(EHASHIDS_UNLIKELY(size < EHASHIDS_COMPILED_HEADER + EHASHIDS_COMPILED_TRAILER ||
+                         memcmp(data, EHASHIDS_COMPILED_MAGIC, 4) != 0)){
+        return "badarg";
+    }
+    if(EHASHIDS_UNLIKELY(data[4] != EHASHIDS_COMPILED_VERSION)) return "version";
+
+    source->alphabet_length = ehashids_get_le(data + 6, 2);
+    source->separators_count = ehashids_get_le(data + 8, 2);
+    source->guards_count = ehashids_get_le(data + 10, 2);
+    source->salt_length = ehashids_get_le(data + 12, 4);
+    source->min_hash_length = ehashids_get_le(data + 16, 4);
+
+    if(EHASHIDS_UNLIKELY(size - EHASHIDS_COMPILED_HEADER - EHASHIDS_COMPILED_TRAILER !=
+                         source->alphabet_length + source->salt_length +
+                         source->separators_count + source->guards_count)){
+        return "badarg";
+    }
+    if(EHASHIDS_UNLIKELY(ehashids_crc32(data, size - EHASHIDS_COMPILED_TRAILER) !=
+                         ehashids_get_le(data + size - EHASHIDS_COMPILED_TRAILER, 4))){
+        return "checksum";
+    }
+
+    p = data + EHASHIDS_COMPILED_HEADER;
+    source->alphabet = (char *)p;
+    p += source->alphabet_length;
+    source->salt = (char *)p;
+    p += source->salt_length;
+    source->separators = (char *)p;
+    p += source->separators_count;
+    source->guards = (char *)p;
+
+    return NULL;
+}
+
+// Reads a field of the 11-tuple returned by compile/1 in earlier versions
+static int ehashids_unpack_legacy_string(ErlNifEnv *env, ERL_NIF_TERM str, ERL_NIF_TERM length, char **field, size_t *len)
+{
+    ErlNifBinary bin;
+    ErlNifUInt64 value;
+
+    if(!enif_inspect_binary(env, str, &bin) || !enif_get_uint64(env, length, &value)) return 0;
+    if(value > bin.size) return 0;
+
+    *field = (char *)bin.data;
+    *len = (size_t)value;
+    return 1;
+}
+
+static const char *ehashids_unpack_legacy(ErlNifEnv *env, ERL_NIF_TERM compiled, hashids_t *source)
+{
+    const ERL_NIF_TERM *arr;
+    int arity;
+    ErlNifUInt64 min_hash_length;
+
+    if(EHASHIDS_UNLIKELY(!enif_get_tuple(env, compiled, &arity, &arr) || arity != 11)){
+        return "badarg";
+    }
+
+    // {Alphabet, Copy1, Copy2, AlphabetLength, Salt, SaltLength, Separators, SeparatorsCount, Guards, GuardsCount, MinHashLength}
+    if(EHASHIDS_UNLIKELY(!ehashids_unpack_legacy_string(env, arr[0], arr[3], &source->alphabet, &source->alphabet_length) ||
+                         !ehashids_unpack_legacy_string(env, arr[4], arr[5], &source->salt, &source->salt_length) ||
+                         !ehashids_unpack_legacy_string(env, arr[6], arr[7], &source->separators, &source->separators_count) ||
+                         !ehashids_unpack_legacy_string(env, arr[8], arr[9], &source->guards, &source->guards_count) ||
+                         !enif_get_uint64(env, arr[10], &min_hash_length))){
+        return "badarg";
+    }
+    source->min_hash_length = (size_t)min_hash_length;
+
+    return NULL;
+}
+
+/*
+ * Scratch space shared by the NIFs. It starts out on the stack and only grows
+ * onto the heap for unusually large inputs, so a batch reuses the same
+ * buffers for every item.
+ */
+static void ehashids_scratch_init(ehashids_scratch_t *scratch)
+{
+    scratch->numbers = scratch->numbers_stack;
+    scratch->numbers_size = EHASHIDS_STACK_NUMBERS;
+    scratch->buffer = scratch->buffer_stack;
+    scratch->buffer_size = EHASHIDS_STACK_BUFFER;
+    (void)memset(&scratch->tally, 0, sizeof(ehashids_tally_t));
+}
+
+static void ehashids_scratch_free(ehashids_scratch_t *scratch)
+{
+    if(scratch->numbers != scratch->numbers_stack) enif_free(scratch->numbers);
+    if(scratch->buffer != scratch->buffer_stack) enif_free(scratch->buffer);
+    ehashids_scratch_init(scratch);
+}
+
+static int ehashids_scratch_reserve(ehashids_scratch_t *scratch, size_t numbers_size, size_t buffer_size)
+{
+    unsigned long long *numbers;
+    char *buffer;
+
+    if(EHASHIDS_UNLIKELY(numbers_size > scratch->numbers_size)){
+        numbers = (unsigned long long *)enif_alloc(sizeof(unsigned long long) * numbers_size);
+        if(numbers == NULL) return 0;
+        if(scratch->numbers != scratch->numbers_stack) enif_free(scratch->numbers);
+        scratch->numbers = numbers;
+        scratch->numbers_size = numbers_size;
+        scratch->tally.counts[EHASHIDS_STAT_REGROW]++;
+        scratch->tally.counts[EHASHIDS_STAT_BYTES] += sizeof(unsigned long long) * numbers_size;
+    }
+
+    if(EHASHIDS_UNLIKELY(buffer_size > scratch->buffer_size)){
+        buffer = (char *)enif_alloc(buffer_size);
+        if(buffer == NULL) return 0;
+        if(scratch->buffer != scratch->buffer_stack) enif_free(scratch->buffer);
+        scratch->buffer = buffer;
+        scratch->buffer_size = buffer_size;
+        scratch->tally.counts[EHASHIDS_STAT_REGROW]++;
+        scratch->tally.counts[EHASHIDS_STAT_BYTES] += buffer_size;
+    }
+
+    return 1;
+}
+
+// Stripe of the calling thread, threads are given one in turn on their first call
+static unsigned int ehashids_stripe(void)
+{
+    static unsigned int next = 0;
+    static _Thread_local unsigned int stripe = 0;
+
+    if(EHASHIDS_UNLIKELY(stripe == 0)){
+        stripe = 1 + __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % EHASHIDS_STATS_STRIPES;
+    }
+
+    return stripe - 1;
+}
+
+static void ehashids_stats_add(ehashids_stats_t *stats, const ehashids_tally_t *tally, unsigned int stripe)
+{
+    for(int i = 0; i < EHASHIDS_STAT_COUNT; i++){
+        if(tally->counts[i] != 0){
+            (void)__atomic_fetch_add(&stats->stripes[stripe].counts[i], tally->counts[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Counts the outcome of an encode or decode into the tally
+static void ehashids_tally_result(ehashids_tally_t *tally, const char *reason)
+{
+    if(reason == NULL) return;
+
+    if(strcmp(reason, "invalid_hash") == 0) tally->counts[EHASHIDS_STAT_INVALID_HASH]++;
+    else if(strcmp(reason, "unsafe") == 0) tally->counts[EHASHIDS_STAT_UNSAFE]++;
+    else tally->counts[EHASHIDS_STAT_ERROR]++;
+}
+
+// ehashids_scratch_free() that first adds the tally to the context and module counters
+static void ehashids_scratch_done(ErlNifEnv *env, ehashids_t *ctx, ehashids_scratch_t *scratch)
+{
+    unsigned int stripe = ehashids_stripe();
+
+    ehashids_stats_add(ctx->stats, &scratch->tally, stripe);
+    ehashids_stats_add(&((ehashids_priv_t *)enif_priv_data(env))->shared->stats, &scratch->tally, stripe);
+    ehashids_scratch_free(scratch);
+}
+
+// Upper bound of what ehashids_encode() writes for numbers_count 64 bit numbers
+static size_t ehashids_encoded_size_max(const ehashids_t *ctx, size_t numbers_count)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    unsigned long long number = ~0ULL;
+    size_t digits = 0;
+    size_t size;
+
+    do {
+        digits++;
+        number /= hashids->alphabet_length;
+    } while(number);
+
+    size = 1 + numbers_count * (digits + 1);
+    return size < hashids->min_hash_length ? hashids->min_hash_length : size;
+}
+
+// Reads a list of len numbers into the scratch space, returns an error reason or NULL
+static const char *ehashids_get_numbers(ErlNifEnv *env, ehashids_scratch_t *scratch, ERL_NIF_TERM list, unsigned int len)
+{
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(scratch, len, 0))){
+        return "alloc";
+    }
+
+    for(unsigned int i = 0; i < len; i++, list = tail){
+        if(EHASHIDS_UNLIKELY(!enif_get_list_cell(env, list, &head, &tail))){
+            return "numbers";
+        }
+        if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, head, (ErlNifUInt64 *)scratch->numbers + i))){
+            return "numbers";
+        }
+    }
+
+    return NULL;
+}
+
+// Encodes the numbers held in the scratch space into a binary, returns an error reason or NULL
+static const char *ehashids_encode_numbers(ErlNifEnv *env, const ehashids_t *ctx, ehashids_scratch_t *scratch, size_t count, ERL_NIF_TERM *out)
+{
+    unsigned char *data;
+    size_t len;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(scratch, 0, ehashids_encoded_size_max(ctx, count)))){
+        return "alloc";
+    }
+
+    len = ehashids_encode(ctx, scratch->buffer, count, scratch->numbers);
+    if(EHASHIDS_UNLIKELY(len == 0)) return "numbers";
+
+    data = enif_make_new_binary(env, len, out);
+    if(EHASHIDS_UNLIKELY(data == NULL)) return "alloc";
+    (void)memcpy(data, scratch->buffer, len);
+    scratch->tally.counts[EHASHIDS_STAT_ENCODE]++;
+    scratch->tally.counts[EHASHIDS_STAT_BYTES] += len;
+
+    return NULL;
+}
+
+/*
+ * Numbers wider than 64 bits. They are kept as little endian 32 bit limbs,
+ * all numbers of a call back to back, and only used when a number does not
+ * fit an unsigned long long so the common case never pays for them. The
+ * arithmetic is exact, numbers below 2^64 encode to the same ids as on the
+ * 64 bit path.
+ */
+typedef struct {
+    uint32_t *limbs;
+    size_t limbs_size;
+    size_t limbs_count;
+    size_t *offsets;
+    size_t count;
+    size_t width;
+    uint32_t *work;
+} ehashids_bignums_t;
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 ehashids_wide_t;
+#   define EHASHIDS_WIDE_LIMBS 4
+#else
+typedef unsigned long long ehashids_wide_t;
+#   define EHASHIDS_WIDE_LIMBS 2
+#endif
+
+static void ehashids_bignums_init(ehashids_bignums_t *b)
+{
+    (void)memset(b, 0, sizeof(ehashids_bignums_t));
+}
+
+static void ehashids_bignums_free(ehashids_bignums_t *b)
+{
+    if(b->limbs) enif_free(b->limbs);
+    if(b->offsets) enif_free(b->offsets);
+    if(b->work) enif_free(b->work);
+    ehashids_bignums_init(b);
+}
+
+// Makes room for count numbers of up to limbs limbs in total
+static int ehashids_bignums_reserve(ehashids_bignums_t *b, size_t count, size_t limbs)
+{
+    b->offsets = (size_t *)enif_alloc(sizeof(size_t) * (count + 1));
+    b->limbs = (uint32_t *)enif_alloc(sizeof(uint32_t) * (limbs ? limbs : 1));
+    if(EHASHIDS_UNLIKELY(b->offsets == NULL || b->limbs == NULL)) return 0;
+
+    b->limbs_size = limbs;
+    b->offsets[0] = 0;
+    return 1;
+}
+
+static size_t ehashids_big_trim(const uint32_t *limbs, size_t n)
+{
+    while(n > 0 && limbs[n - 1] == 0) n--;
+    return n;
+}
+
+// Closes the number being built at the end of the limbs
+static void ehashids_bignums_close(ehashids_bignums_t *b)
+{
+    size_t start = b->offsets[b->count];
+    size_t n = ehashids_big_trim(b->limbs + start, b->limbs_count - start);
+
+    b->limbs_count = start + n;
+    if(n > b->width) b->width = n;
+    b->offsets[++b->count] = b->limbs_count;
+}
+
+static int ehashids_bignums_push(ehashids_bignums_t *b, const unsigned char *bytes, size_t size)
+{
+    uint32_t *limbs;
+    size_t n = (size + 3) / 4;
+    size_t i;
+
+    if(b->limbs_count + n > b->limbs_size){
+        limbs = (uint32_t *)enif_realloc(b->limbs, sizeof(uint32_t) * (b->limbs_size * 2 + n));
+        if(EHASHIDS_UNLIKELY(limbs == NULL)) return 0;
+        b->limbs = limbs;
+        b->limbs_size = b->limbs_size * 2 + n;
+    }
+
+    limbs = b->limbs + b->limbs_count;
+    (void)memset(limbs, 0, sizeof(uint32_t) * n);
+    for(i = 0; i < size; i++){
+        limbs[i / 4] |= (uint32_t)bytes[i] << (8 * (i % 4));
+    }
+    b->limbs_count += n;
+    ehashids_bignums_close(b);
+
+    return 1;
+}
+
+/*
+ * Appends a non negative integer of any size. There is no NIF call to read a
+ * bignum so it goes through its external term format, SMALL_BIG_EXT or
+ * LARGE_BIG_EXT, which stores the magnitude as little endian bytes.
+ */
+static const char *ehashids_get_bignum(ErlNifEnv *env, ERL_NIF_TERM term, ehashids_bignums_t *b)
+{
+    ErlNifUInt64 number;
+    unsigned char bytes[8];
+    ErlNifBinary ext;
+    const unsigned char *digits;
+    size_t size;
+    int ok;
+
+    if(EHASHIDS_LIKELY(enif_get_uint64(env, term, &number))){
+        for(size = 0; size < 8; size++, number >>= 8) bytes[size] = (unsigned char)(number & 0xFF);
+        return ehashids_bignums_push(b, bytes, 8) ? NULL : "alloc";
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_is_number(env, term))) return "numbers";
+    if(EHASHIDS_UNLIKELY(!enif_term_to_binary(env, term, &ext))) return "alloc";
+
+    if(ext.size > 7 && ext.data[1] == 111){
+        size = ext.data[2];
+        size = (size << 8) | ext.data[3];
+        size = (size << 8) | ext.data[4];
+        size = (size << 8) | ext.data[5];
+        digits = ext.data + 7;
+    } else if(ext.size > 4 && ext.data[1] == 110){
+        size = ext.data[2];
+        digits = ext.data + 4;
+    } else {
+        // a float, or a negative integer small enough for INTEGER_EXT
+        enif_release_binary(&ext);
+        return "numbers";
+    }
+
+    if(EHASHIDS_UNLIKELY(digits[-1] != 0 || size * 8 > EHASHIDS_BIG_BITS_MAX)){
+        enif_release_binary(&ext);
+        return "numbers";
+    }
+
+    ok = ehashids_bignums_push(b, digits, size);
+    enif_release_binary(&ext);
+
+    return ok ? NULL : "alloc";
+}
+
+// Reads a list of len non negative integers of any size, returns an error reason or NULL
+static const char *ehashids_get_bignums(ErlNifEnv *env, ehashids_bignums_t *b, ERL_NIF_TERM list, unsigned int len)
+{
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+    const char *reason;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_bignums_reserve(b, len, (size_t)len * 2))) return "alloc";
+
+    for(unsigned int i = 0; i < len; i++, list = tail){
+        if(EHASHIDS_UNLIKELY(!enif_get_list_cell(env, list, &head, &tail))){
+            return "numbers";
+        }
+        reason = ehashids_get_bignum(env, head, b);
+        if(EHASHIDS_UNLIKELY(reason != NULL)) return reason;
+    }
+
+    return NULL;
+}
+
+// Remainder of a number divided by m
+static unsigned long long ehashids_big_mod(const uint32_t *limbs, size_t n, unsigned long long m)
+{
+#ifdef __SIZEOF_INT128__
+    ehashids_wide_t r = 0;
+
+    while(n--) r = ((r << 32) | limbs[n]) % m;
+    return (unsigned long long)r;
+#else
+    unsigned long long r = 0;
+    unsigned long long top;
+    int bit;
+
+    if(m <= 0xFFFFFFFFULL){
+        while(n--) r = ((r << 32) | limbs[n]) % m;
+        return r;
+    }
+
+    // long division a bit at a time, r stays below m so one subtraction is enough
+    while(n--){
+        for(bit = 31; bit >= 0; bit--){
+            top = r >> 63;
+            r = (r << 1) | ((limbs[n] >> bit) & 1);
+            if(top || r >= m) r -= m;
+        }
+    }
+    return r;
+#endif
+}
+
+// Divides a number in place by d and returns the remainder
+static unsigned int ehashids_big_divmod(uint32_t *limbs, size_t *n, unsigned int d)
+{
+    unsigned long long r = 0;
+    unsigned long long cur;
+    size_t i = *n;
+
+    while(i--){
+        cur = (r << 32) | limbs[i];
+        limbs[i] = (uint32_t)(cur / d);
+        r = cur % d;
+    }
+    *n = ehashids_big_trim(limbs, *n);
+
+    return (unsigned int)r;
+}
+
+/*
+ * Writes the digits of a number least significant first. Long division by the
+ * alphabet length runs until the number fits a machine word, the rest of the
+ * digits come from native 128 bit (or 64 bit) arithmetic.
+ */
+static char *ehashids_big_digits(char *end, const char *alphabet, size_t alphabet_length, uint32_t *work, const uint32_t *limbs, size_t n)
+{
+    ehashids_wide_t number = 0;
+
+    (void)memcpy(work, limbs, sizeof(uint32_t) * n);
+    while(n > EHASHIDS_WIDE_LIMBS){
+        *end++ = alphabet[ehashids_big_divmod(work, &n, (unsigned int)alphabet_length)];
+    }
+
+    while(n--) number = (number << 32) | work[n];
+    do {
+        *end++ = alphabet[number % alphabet_length];
+        number /= alphabet_length;
+    } while(number);
+
+    return end;
+}
+
+// Upper bound of what ehashids_encode_big() writes
+static size_t ehashids_big_encoded_size_max(const ehashids_t *ctx, const ehashids_bignums_t *b)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    size_t bits_per_digit = 0;
+    size_t size = 1;
+    size_t i;
+
+    // floor(log2(alphabet_length)), every digit holds at least this many bits
+    while(((size_t)2 << bits_per_digit) <= hashids->alphabet_length) bits_per_digit++;
+
+    for(i = 0; i < b->count; i++){
+        size += (b->offsets[i + 1] - b->offsets[i]) * 32 / bits_per_digit + 2;
+    }
+
+    return size < hashids->min_hash_length ? hashids->min_hash_length : size;
+}
+
+// ehashids_encode() for numbers of any size, b->work must hold b->width limbs
+static size_t ehashids_encode_big(const ehashids_t *ctx, char *buffer, const ehashids_bignums_t *b)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    char alphabet[EHASHIDS_MAX_ALPHABET];
+    char salt[EHASHIDS_MAX_ALPHABET];
+    size_t alphabet_length = hashids->alphabet_length;
+    unsigned long long numbers_hash;
+    unsigned long long number;
+    const uint32_t *limbs;
+    size_t n;
+    char *start;
+    char *end;
+    char *left;
+    char *right;
+    char lottery;
+    char temp;
+    size_t i;
+
+    if(EHASHIDS_UNLIKELY(b->count == 0)) return 0;
+
+    for(i = 0, numbers_hash = 0; i < b->count; i++){
+        numbers_hash += ehashids_big_mod(b->limbs + b->offsets[i], b->offsets[i + 1] - b->offsets[i], i + 100);
+    }
+
+    lottery = hashids->alphabet[numbers_hash % alphabet_length];
+    buffer[0] = lottery;
+    end = buffer + 1;
+
+    for(i = 0; i < b->count; i++){
+        limbs = b->limbs + b->offsets[i];
+        n = b->offsets[i + 1] - b->offsets[i];
+
+        if(i == 0){
+            ehashids_first_shuffle(ctx, alphabet, salt, lottery, NULL);
+        } else {
+            ehashids_iteration_salt(hashids, salt, lottery, alphabet);
+            ehashids_shuffle(alphabet, alphabet_length, salt, alphabet_length);
+        }
+
+        start = end;
+        end = ehashids_big_digits(end, alphabet, alphabet_length, b->work, limbs, n);
+
+        for(left = start, right = end - 1; left < right; left++, right--){
+            temp = *left;
+            *left = *right;
+            *right = temp;
+        }
+
+        if(i + 1 < b->count){
+            number = ehashids_big_mod(limbs, n, start[0] + i);
+            *end++ = hashids->separators[number % hashids->separators_count];
+        }
+    }
+
+    if((size_t)(end - buffer) < hashids->min_hash_length){
+        return ehashids_pad(hashids, buffer, (size_t)(end - buffer), numbers_hash, alphabet, salt, NULL, 0);
+    }
+
+    return (size_t)(end - buffer);
+}
+
+/*
+ * ehashids_decode() for numbers of any size. Returns an error reason or NULL,
+ * numbers wider than EHASHIDS_BIG_BITS_MAX make the hash invalid since
+ * encode never produces them.
+ */
+static const char *ehashids_decode_big(const ehashids_t *ctx, const char *start, const char *end, size_t count, ehashids_bignums_t *b)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    char alphabet[EHASHIDS_MAX_ALPHABET];
+    char salt[EHASHIDS_MAX_ALPHABET];
+    unsigned char indexes[256];
+    size_t alphabet_length = hashids->alphabet_length;
+    const unsigned char *p;
+    unsigned long long cur;
+    uint32_t carry;
+    uint32_t *limbs;
+    size_t n = 0;
+    size_t i;
+    char lottery;
+
+    // every digit adds at most 8 bits
+    if(EHASHIDS_UNLIKELY(!ehashids_bignums_reserve(b, count, (size_t)(end - start) / 4 + count * 2))){
+        return "alloc";
+    }
+
+    lottery = *start++;
+
+    ehashids_first_shuffle(ctx, alphabet, salt, lottery, indexes);
+
+    limbs = b->limbs;
+    for(p = (const unsigned char *)start;; p++){
+        if(p == (const unsigned char *)end || ctx->classes[*p] == EHASHIDS_CLASS_SEPARATOR){
+            b->limbs_count += n;
+            ehashids_bignums_close(b);
+            if(p == (const unsigned char *)end) break;
+
+            limbs = b->limbs + b->limbs_count;
+            n = 0;
+            ehashids_iteration_salt(hashids, salt, lottery, alphabet);
+            ehashids_shuffle_indexed(alphabet, alphabet_length, salt, alphabet_length, indexes);
+            continue;
+        }
+
+        carry = indexes[*p];
+        for(i = 0; i < n; i++){
+            cur = (unsigned long long)limbs[i] * alphabet_length + carry;
+            limbs[i] = (uint32_t)cur;
+            carry = (uint32_t)(cur >> 32);
+        }
+        if(carry){
+            if(EHASHIDS_UNLIKELY(n * 32 >= EHASHIDS_BIG_BITS_MAX)) return "invalid_hash";
+            limbs[n++] = carry;
+        }
+    }
+
+    return NULL;
+}
+
+// Makes an integer term out of a number
+static ERL_NIF_TERM ehashids_make_bignum(ErlNifEnv *env, const uint32_t *limbs, size_t n)
+{
+    unsigned char ext[7 + EHASHIDS_BIG_BITS_MAX / 8];
+    unsigned char *digits;
+    ERL_NIF_TERM term;
+    size_t size;
+    size_t i;
+
+    if(n <= 2){
+        return enif_make_uint64(env, (ErlNifUInt64)(n > 0 ? limbs[0] : 0) | (ErlNifUInt64)(n > 1 ? limbs[1] : 0) << 32);
+    }
+
+    size = n * 4;
+    while(((limbs[(size - 1) / 4] >> (8 * ((size - 1) % 4))) & 0xFF) == 0) size--;
+
+    ext[0] = 131;
+    if(size <= 255){
+        ext[1] = 110;
+        ext[2] = (unsigned char)size;
+        ext[3] = 0;
+        digits = ext + 4;
+    } else {
+        ext[1] = 111;
+        ext[2] = (unsigned char)(size >> 24);
+        ext[3] = (unsigned char)(size >> 16);
+        ext[4] = (unsigned char)(size >> 8);
+        ext[5] = (unsigned char)size;
+        ext[6] = 0;
+        digits = ext + 7;
+    }
+    for(i = 0; i < size; i++){
+        digits[i] = (unsigned char)(limbs[i / 4] >> (8 * (i % 4)));
+    }
+
+    (void)enif_binary_to_term(env, ext, (size_t)(digits - ext) + size, &term, 0);
+    return term;
+}
+
+// Encodes the numbers held in b into a binary, returns an error reason or NULL
+static const char *ehashids_encode_bignums(ErlNifEnv *env, const ehashids_t *ctx, ehashids_scratch_t *scratch, ehashids_bignums_t *b, ERL_NIF_TERM *out)
+{
+    unsigned char *data;
+    size_t len;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(scratch, 0, ehashids_big_encoded_size_max(ctx, b)))){
+        return "alloc";
+    }
+    b->work = (uint32_t *)enif_alloc(sizeof(uint32_t) * (b->width ? b->width : 1));
+    if(EHASHIDS_UNLIKELY(b->work == NULL)) return "alloc";
+
+    len = ehashids_encode_big(ctx, scratch->buffer, b);
+    if(EHASHIDS_UNLIKELY(len == 0)) return "numbers";
+    scratch->tally.counts[EHASHIDS_STAT_WIDE]++;
+
+    data = enif_make_new_binary(env, len, out);
+    if(EHASHIDS_UNLIKELY(data == NULL)) return "alloc";
+    (void)memcpy(data, scratch->buffer, len);
+    scratch->tally.counts[EHASHIDS_STAT_ENCODE]++;
+    scratch->tally.counts[EHASHIDS_STAT_BYTES] += len;
+
+    return NULL;
+}
+
+// The part of ehashids_decode_binary() for ids holding numbers wider than 64 bits
+static const char *ehashids_decode_binary_big(ErlNifEnv *env, const ehashids_t *ctx, ehashids_scratch_t *scratch, const ErlNifBinary *id_bin, const char *start, const char *end, size_t count, int safe, ERL_NIF_TERM *out)
+{
+    ehashids_bignums_t b;
+    const char *reason;
+    size_t len;
+
+    scratch->tally.counts[EHASHIDS_STAT_WIDE]++;
+
+    ehashids_bignums_init(&b);
+    reason = ehashids_decode_big(ctx, start, end, count, &b);
+
+    if(reason == NULL && safe){
+        b.work = (uint32_t *)enif_alloc(sizeof(uint32_t) * (b.width ? b.width : 1));
+        if(EHASHIDS_UNLIKELY(b.work == NULL || !ehashids_scratch_reserve(scratch, 0, ehashids_big_encoded_size_max(ctx, &b)))){
+            reason = "alloc";
+        } else {
+            len = ehashids_encode_big(ctx, scratch->buffer, &b);
+            if(len != id_bin->size || memcmp(scratch->buffer, id_bin->data, len) != 0){
+                reason = "unsafe";
+            }
+        }
+    }
+
+    if(reason == NULL){
+        *out = enif_make_list(env, 0);
+        while(count > 0){
+            count--;
+            *out = enif_make_list_cell(env, ehashids_make_bignum(env, b.limbs + b.offsets[count], b.offsets[count + 1] - b.offsets[count]), *out);
+        }
+    }
+    ehashids_bignums_free(&b);
+
+    return reason;
+}
+
+/*
+ * The decode cache of ctx when it has one and the id can be kept in it,
+ * else NULL. *hash is then the hash of the id.
+ */
+static ehashids_decode_cache_t *ehashids_decode_cache_for(const ehashids_t *ctx, const ErlNifBinary *id_bin, uint64_t *hash)
+{
+    ehashids_decode_cache_t *cache = __atomic_load_n(&ctx->decode_cache, __ATOMIC_ACQUIRE);
+
+    if(EHASHIDS_LIKELY(cache == NULL) || id_bin->size == 0 || id_bin->size > EHASHIDS_DECODE_CACHE_ID) return NULL;
+
+    *hash = ehashids_decode_cache_hash(id_bin);
+    return cache;
+}
+
+/*
+ * Decodes an id binary into a list of numbers, returns an error reason or NULL.
+ * The id is read in place, sub-binaries included, and the numbers are counted
+ * before decoding so the numbers array is sized once. When safe is set the
+ * numbers are encoded again into the scratch buffer and the id is rejected as
+ * unsafe unless both are identical. With a decode cache short ids are looked
+ * up there first and kept there once decoded.
+ */
+static const char *ehashids_decode_binary(ErlNifEnv *env, const ehashids_t *ctx, ehashids_scratch_t *scratch, const ErlNifBinary *id_bin, int safe, ERL_NIF_TERM *out)
+{
+    ehashids_decode_cache_t *cache;
+    ehashids_decoded_t hit;
+    uint64_t hash = 0;
+    int canonical = EHASHIDS_CANONICAL_UNKNOWN;
+    const char *start;
+    const char *end;
+    size_t count;
+    size_t len;
+
+    scratch->tally.counts[EHASHIDS_STAT_DECODE]++;
+
+    cache = ehashids_decode_cache_for(ctx, id_bin, &hash);
+    if(cache != NULL){
+        // an entry decoded without the check doesn't answer decode_safe/2, it is stored again with it
+        if(ehashids_decode_cache_find(cache, hash, id_bin, &hit) && !(safe && hit.canonical == EHASHIDS_CANONICAL_UNKNOWN)){
+            scratch->tally.counts[EHASHIDS_STAT_CACHE_HIT]++;
+            if(safe && !hit.canonical) return "unsafe";
+            *out = enif_make_list(env, 0);
+            while(hit.count > 0){
+                hit.count--;
+                *out = enif_make_list_cell(env, enif_make_uint64(env, (ErlNifUInt64)hit.numbers[hit.count]), *out);
+            }
+            return NULL;
+        }
+        scratch->tally.counts[EHASHIDS_STAT_CACHE_MISS]++;
+    }
+
+    if(EHASHIDS_UNLIKELY(!ehashids_valid(ctx, id_bin->data, id_bin->size))) return "invalid_hash";
+
+    count = ehashids_numbers_count(ctx, (const char *)id_bin->data, id_bin->size, &start, &end);
+    if(EHASHIDS_UNLIKELY(count == 0)) return "invalid_hash";
+
+    if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(scratch, count, 0))){
+        return "alloc";
+    }
+    if(EHASHIDS_UNLIKELY(!ehashids_decode(ctx, start, end, scratch->numbers))){
+        return ehashids_decode_binary_big(env, ctx, scratch, id_bin, start, end, count, safe, out);
+    }
+
+    if(safe){
+        if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(scratch, 0, ehashids_encoded_size_max(ctx, count)))){
+            return "alloc";
+        }
+        len = ehashids_encode(ctx, scratch->buffer, count, scratch->numbers);
+        canonical = len == id_bin->size && memcmp(scratch->buffer, id_bin->data, len) == 0;
+    }
+
+    if(cache != NULL && count <= EHASHIDS_DECODE_CACHE_NUMBERS &&
+       ehashids_decode_cache_store(cache, hash, id_bin, scratch->numbers, count, canonical)){
+        scratch->tally.counts[EHASHIDS_STAT_CACHE_EVICT]++;
+    }
+
+    if(safe && !canonical) return "unsafe";
+
+    *out = enif_make_list(env, 0);
+    while(count > 0){
+        count--;
+        *out = enif_make_list_cell(env, enif_make_uint64(env, (ErlNifUInt64)scratch->numbers[count]), *out);
+    }
+
+    return NULL;
+}
+
+// ehashids_decode_binary() for ids of exactly one number, *out is the bare number
+static const char *ehashids_decode_one(ErlNifEnv *env, const ehashids_t *ctx, ehashids_scratch_t *scratch, const ErlNifBinary *id_bin, ERL_NIF_TERM *out)
+{
+    ehashids_decode_cache_t *cache;
+    ehashids_decoded_t hit;
+    uint64_t hash = 0;
+    unsigned long long number;
+    const char *reason;
+    const char *start;
+    const char *end;
+    ERL_NIF_TERM list;
+    ERL_NIF_TERM tail;
+
+    scratch->tally.counts[EHASHIDS_STAT_DECODE]++;
+
+    cache = ehashids_decode_cache_for(ctx, id_bin, &hash);
+    if(cache != NULL){
+        if(ehashids_decode_cache_find(cache, hash, id_bin, &hit)){
+            scratch->tally.counts[EHASHIDS_STAT_CACHE_HIT]++;
+            if(hit.count != 1) return "invalid_hash";
+            *out = enif_make_uint64(env, (ErlNifUInt64)hit.numbers[0]);
+            return NULL;
+        }
+        scratch->tally.counts[EHASHIDS_STAT_CACHE_MISS]++;
+    }
+
+    if(EHASHIDS_UNLIKELY(!ehashids_valid(ctx, id_bin->data, id_bin->size))) return "invalid_hash";
+
+    if(EHASHIDS_UNLIKELY(ehashids_numbers_count(ctx, (const char *)id_bin->data, id_bin->size, &start, &end) != 1)){
+        return "invalid_hash";
+    }
+
+    if(EHASHIDS_UNLIKELY(!ehashids_decode(ctx, start, end, &number))){
+        reason = ehashids_decode_binary_big(env, ctx, scratch, id_bin, start, end, 1, 0, &list);
+        if(reason == NULL) (void)enif_get_list_cell(env, list, out, &tail);
+        return reason;
+    }
+
+    if(cache != NULL && ehashids_decode_cache_store(cache, hash, id_bin, &number, 1, EHASHIDS_CANONICAL_UNKNOWN)){
+        scratch->tally.counts[EHASHIDS_STAT_CACHE_EVICT]++;
+    }
+
+    *out = enif_make_uint64(env, (ErlNifUInt64)number);
+    return NULL;
+}
+
+// Reports the time used since *last to the VM, returns 1 when the NIF should yield
+static int ehashids_consume_timeslice(ErlNifEnv *env, ErlNifTime *last)
+{
+    ErlNifTime now = enif_monotonic_time(ERL_NIF_USEC);
+    ErlNifTime percent = (now - *last) * 100 / EHASHIDS_TIMESLICE_USEC;
+
+    if(percent < 1) return 0;
+    if(percent > 100) percent = 100;
+    *last = now;
+
+    return enif_consume_timeslice(env, (int)percent);
+}
+
+/*
+ * Checks an alphabet for new/3. Like in hashids.c it ends at the first zero
+ * byte and needs EHASHIDS_MIN_ALPHABET_LENGTH distinct characters and no
+ * blanks.
+ */
+static const char *ehashids_check_alphabet(const ErlNifBinary *alphabet)
+{
+    unsigned char seen[256] = {0};
+    size_t distinct = 0;
+    size_t i;
+
+    for(i = 0; i < alphabet->size && alphabet->data[i] != '\0'; i++){
+        if(!seen[alphabet->data[i]]){
+            seen[alphabet->data[i]] = 1;
+            distinct++;
+        }
+    }
+
+    if(distinct < EHASHIDS_MIN_ALPHABET_LENGTH) return "alphabet_length";
+    if(seen[' '] || seen['\t']) return "alphabet_space";
+
+    return NULL;
+}
+
+/*
+ * Derives the parameters of a context from a checked alphabet the way
+ * hashids_init3() of hashids.c does. The default separators found in the
+ * alphabet are moved out of it and shuffled, then separators are taken from
+ * the alphabet until it is at most 3.5 times longer, and after the alphabet
+ * is shuffled one in twelve of its characters become guards. The salt ends
+ * at its first zero byte and is used in place, the other strings are built
+ * in buffer, which holds 3 * EHASHIDS_MAX_ALPHABET bytes.
+ */
+static void ehashids_setup(const ErlNifBinary *salt, unsigned int min_hash_length, const ErlNifBinary *alphabet, char *buffer, hashids_t *out)
+{
+    unsigned char seen[256] = {0};
+    char *chars = buffer;
+    char *separators = buffer + EHASHIDS_MAX_ALPHABET;
+    char *guards = buffer + 2 * EHASHIDS_MAX_ALPHABET;
+    const char *separator;
+    const char *zero;
+    size_t chars_length = 0;
+    size_t separators_count = 0;
+    size_t guards_count;
+    size_t wanted;
+    size_t i;
+
+    for(i = 0; i < alphabet->size && alphabet->data[i] != '\0'; i++){
+        if(!seen[alphabet->data[i]]){
+            seen[alphabet->data[i]] = 1;
+            chars[chars_length++] = (char)alphabet->data[i];
+        }
+    }
+
+    out->salt = (char *)salt->data;
+    zero = (const char *)memchr(salt->data, '\0', salt->size);
+    out->salt_length = zero != NULL ? (size_t)(zero - out->salt) : salt->size;
+
+    for(separator = EHASHIDS_DEFAULT_SEPARATORS; *separator != '\0'; separator++){
+        if(!seen[(unsigned char)*separator]) continue;
+
+        separators[separators_count++] = *separator;
+        for(i = 0; chars[i] != *separator; i++);
+        (void)memmove(chars + i, chars + i + 1, chars_length - i - 1);
+        chars_length--;
+    }
+    ehashids_shuffle(separators, separators_count, out->salt, out->salt_length);
+
+    // ceil(chars_length / 3.5) computed exactly
+    if(separators_count == 0 || 2 * chars_length > 7 * separators_count){
+        wanted = (2 * chars_length + 6) / 7;
+        if(wanted == 1) wanted = 2;
+
+        if(wanted > separators_count){
+            (void)memcpy(separators + separators_count, chars, wanted - separators_count);
+            (void)memmove(chars, chars + wanted - separators_count, chars_length - (wanted - separators_count));
+            chars_length -= wanted - separators_count;
+        }
+        separators_count = wanted;
+    }
+    ehashids_shuffle(chars, chars_length, out->salt, out->salt_length);
+
+    guards_count = (chars_length + 11) / 12;
+    if(chars_length < 3){
+        (void)memcpy(guards, separators, guards_count);
+        (void)memmove(separators, separators + guards_count, separators_count - guards_count);
+        separators_count -= guards_count;
+    } else {
+        (void)memcpy(guards, chars, guards_count);
+        (void)memmove(chars, chars + guards_count, chars_length - guards_count);
+        chars_length -= guards_count;
+    }
+
+    out->alphabet = chars;
+    out->alphabet_length = chars_length;
+    out->separators = separators;
+    out->separators_count = separators_count;
+    out->guards = guards;
+    out->guards_count = guards_count;
+    out->min_hash_length = min_hash_length;
+}
+
+/*
+ * new/0..3. The arguments are looked up in the context cache first, only a
+ * miss runs ehashids_setup() and its shuffles. The new context is created
+ * outside of the cache lock, when another call added the same parameters in
+ * the meantime the cached context wins and this one is dropped.
+ */
+static ERL_NIF_TERM hashids_init_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_cache_t *cache = &((ehashids_priv_t *)enif_priv_data(env))->shared->cache;
+    hashids_t source;
+    ehashids_t *ctx;
+    ehashids_t *cached;
+    uint64_t hash = 0;
+    int res;
+    const char *reason;
+    ERL_NIF_TERM resource;
+    char strings[3 * EHASHIDS_MAX_ALPHABET];
+    ErlNifBinary salt_bin;
+    ErlNifBinary alphabet_bin;
+    unsigned int min_hash_length = EHASHIDS_DEFAULT_MIN_HASH_LENGTH;
+
+    if(EHASHIDS_UNLIKELY(argc > 3)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    salt_bin.data = (unsigned char *)EHASHIDS_DEFAULT_SALT;
+    salt_bin.size = sizeof(EHASHIDS_DEFAULT_SALT) - 1;
+    alphabet_bin.data = (unsigned char *)EHASHIDS_DEFAULT_ALPHABET;
+    alphabet_bin.size = sizeof(EHASHIDS_DEFAULT_ALPHABET) - 1;
+
+    if(argc > 0){
+        res = enif_inspect_binary(env, argv[0], &salt_bin);
+        if(res == 0){
+            return make_error_tuple_from_string(env, "salt");
+        }
+    }
+
+    if(argc > 1){
+        res = enif_get_uint(env, argv[1], &min_hash_length);
+        if(res == 0){
+            return make_error_tuple_from_string(env, "min_hash_length");
+        }
+    }
+
+    if(argc > 2){
+        res = enif_inspect_binary(env, argv[2], &alphabet_bin);
+        if(EHASHIDS_UNLIKELY(res == 0)){
+            return make_error_tuple_from_string(env, "alphabet");
+        }
+    }
+
+    if(EHASHIDS_LIKELY(cache->capacity > 0)){
+        hash = ehashids_cache_hash(&salt_bin, min_hash_length, &alphabet_bin);
+        enif_mutex_lock(cache->lock);
+        cached = ehashids_cache_find(cache, hash, &salt_bin, min_hash_length, &alphabet_bin);
+        if(cached != NULL){
+            cache->hits++;
+            resource = enif_make_resource(env, cached);
+            enif_mutex_unlock(cache->lock);
+            return resource;
+        }
+        cache->misses++;
+        enif_mutex_unlock(cache->lock);
+    }
+
+    reason = ehashids_check_alphabet(&alphabet_bin);
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    ehashids_setup(&salt_bin, min_hash_length, &alphabet_bin, strings, &source);
+    reason = ehashids_new_context(env, &source, &ctx);
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    if(EHASHIDS_LIKELY(cache->capacity > 0)){
+        enif_mutex_lock(cache->lock);
+        cached = ehashids_cache_find(cache, hash, &salt_bin, min_hash_length, &alphabet_bin);
+        if(cached == NULL){
+            ehashids_cache_insert(cache, hash, &salt_bin, min_hash_length, &alphabet_bin, ctx);
+            cached = ctx;
+        }
+        resource = enif_make_resource(env, cached);
+        enif_mutex_unlock(cache->lock);
+    } else {
+        resource = enif_make_resource(env, ctx);
+    }
+    enif_release_resource(ctx);
+
+    return resource;
+}
+
+// Same estimate as hashids_estimate_encoded_size() of hashids.c
+static size_t ehashids_estimate_encoded_size(const hashids_t *hashids, size_t numbers_count, const unsigned long long *numbers)
+{
+    unsigned long long number;
+    size_t len = 1;
+    size_t i;
+
+    for(i = 0; i < numbers_count; i++){
+        number = numbers[i];
+        do {
+            len++;
+            number /= hashids->alphabet_length;
+        } while(number);
+        if(i + 1 < numbers_count) len++;
+    }
+    if(len < hashids->min_hash_length) len = hashids->min_hash_length;
+
+    return len + 2;
+}
+
+static ERL_NIF_TERM hashids_estimate_encoded_size_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+    ERL_NIF_TERM tmp;
+    unsigned int len;
+    ErlNifUInt64 *numbers;
+    size_t res;
+
+    assert(sizeof(unsigned long long) == sizeof(ErlNifUInt64));
+
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, argv[1], &len))){
+        return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+    }
+
+    // +1 if the list is empty because we don't want strange behaviour here
+    numbers = (ErlNifUInt64 *)enif_alloc(sizeof(ErlNifUInt64) * (len + 1));
+    if(EHASHIDS_UNLIKELY(!numbers)){
+        return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+    }
+
+    tmp = argv[1];
+    for(unsigned int i = 0; i < len; i++, tmp = tail){
+        if(EHASHIDS_UNLIKELY(!enif_get_list_cell(env, tmp, &head, &tail))){
+            enif_free(numbers);
+            return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+        }
+        if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, head, numbers + i))){
+            enif_free(numbers);
+            return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+        }
+    }
+
+    res = ehashids_estimate_encoded_size(&ctx->hashids, (size_t)len, (const unsigned long long *)numbers);
+    enif_free(numbers);
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), enif_make_uint64(env, res));
+}
+
+/*
+ * Single id encoding and decoding run inline on the calling scheduler. Ids
+ * that can grow past EHASHIDS_DIRTY_BYTES, because of many numbers or a large
+ * min_hash_length, take long enough to hurt the other processes sharing the
+ * scheduler so the call is moved to a dirty CPU scheduler instead.
+ */
+static ERL_NIF_TERM ehashids_encode_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ehashids_bignums_t bignums;
+    const char *reason;
+    unsigned int len;
+    ERL_NIF_TERM final_bin;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, argv[1], &len))){
+        return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+    }
+
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && ehashids_encoded_size_max(ctx, len) > EHASHIDS_DIRTY_BYTES)){
+        return enif_schedule_nif(env, "encode", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_encode_dirty_nif, 2, argv);
+    }
+#endif
+
+    ehashids_scratch_init(&scratch);
+    reason = ehashids_get_numbers(env, &scratch, argv[1], len);
+    if(EHASHIDS_LIKELY(reason == NULL)){
+        reason = ehashids_encode_numbers(env, ctx, &scratch, len, &final_bin);
+    } else {
+        // not all 64 bit numbers, read them again as integers of any size
+        ehashids_bignums_init(&bignums);
+        reason = ehashids_get_bignums(env, &bignums, argv[1], len);
+#ifdef EHASHIDS_DIRTY_NIFS
+        if(reason == NULL && !dirty && (bignums.width * 32 > EHASHIDS_DIRTY_BIG_BITS ||
+                                        ehashids_big_encoded_size_max(ctx, &bignums) > EHASHIDS_DIRTY_BYTES)){
+            ehashids_bignums_free(&bignums);
+            ehashids_scratch_free(&scratch);
+            return enif_schedule_nif(env, "encode", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_encode_dirty_nif, 2, argv);
+        }
+#endif
+        if(reason == NULL){
+            reason = ehashids_encode_bignums(env, ctx, &scratch, &bignums, &final_bin);
+        }
+        ehashids_bignums_free(&bignums);
+    }
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), final_bin);
+}
+
+static ERL_NIF_TERM hashids_encode_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_encode_call(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_call(env, argv, 1);
+}
+
+/*
+ * encode_one/2. A 64 bit number goes straight to ehashids_encode_one() with
+ * the scratch space on the stack, anything else takes the encode/2 path.
+ */
+static ERL_NIF_TERM ehashids_encode_one_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ErlNifUInt64 number;
+    ERL_NIF_TERM list_argv[2];
+    ERL_NIF_TERM final_bin;
+    const char *reason = NULL;
+    unsigned char *data;
+    size_t size;
+    size_t len;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, argv[1], &number))){
+        // wider than 64 bits, or not a number at all
+        list_argv[0] = argv[0];
+        list_argv[1] = enif_make_list1(env, argv[1]);
+        return ehashids_encode_call(env, list_argv, dirty);
+    }
+
+    size = ehashids_encoded_size_max(ctx, 1);
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && size > EHASHIDS_DIRTY_BYTES)){
+        return enif_schedule_nif(env, "encode_one", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_encode_one_dirty_nif, 2, argv);
+    }
+#endif
+
+    ehashids_scratch_init(&scratch);
+    if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(&scratch, 0, size))){
+        reason = "alloc";
+    } else {
+        len = ehashids_encode_one(ctx, scratch.buffer, (unsigned long long)number);
+        data = enif_make_new_binary(env, len, &final_bin);
+        if(EHASHIDS_UNLIKELY(data == NULL)){
+            reason = "alloc";
+        } else {
+            (void)memcpy(data, scratch.buffer, len);
+            scratch.tally.counts[EHASHIDS_STAT_ENCODE]++;
+            scratch.tally.counts[EHASHIDS_STAT_BYTES] += len;
+        }
+    }
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), final_bin);
+}
+
+static ERL_NIF_TERM hashids_encode_one_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_encode_one_call(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_one_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_one_call(env, argv, 1);
+}
+
+/*
+ * Batch encoding. Items are encoded one after the other with a single scratch
+ * space and the results are accumulated in reverse. Every
+ * EHASHIDS_BATCH_CHECK_BYTES of ids the time spent is reported to the VM and
+ * when the timeslice is used up the NIF reschedules itself with the remaining
+ * items and the accumulator. An item that encode/2 would encode dirty sends
+ * it and the rest of the batch to a dirty CPU scheduler, items wider than 64
+ * bits are read first so they are bounded by their real width as there.
+ */
+static ERL_NIF_TERM ehashids_encode_many(ErlNifEnv* env, const ERL_NIF_TERM argv[], int flat, int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ERL_NIF_TERM list = argv[1];
+    ERL_NIF_TERM acc = argv[2];
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+    ERL_NIF_TERM bin;
+    ERL_NIF_TERM result;
+    ERL_NIF_TERM next_argv[3];
+    ehashids_bignums_t bignums;
+    ErlNifTime last;
+    const char *reason = NULL;
+    unsigned int len = 1;
+    size_t size;
+    size_t work = 0;
+    int wide;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    last = enif_monotonic_time(ERL_NIF_USEC);
+    ehashids_scratch_init(&scratch);
+    ehashids_bignums_init(&bignums);
+
+    while(enif_get_list_cell(env, list, &head, &tail)){
+        if(!flat && EHASHIDS_UNLIKELY(!enif_get_list_length(env, head, &len))){
+            reason = "numbers";
+            break;
+        }
+
+        // items that are not all 64 bit numbers are read again as integers of any size
+        if(flat ? EHASHIDS_LIKELY(enif_get_uint64(env, head, (ErlNifUInt64 *)scratch.numbers))
+                : EHASHIDS_LIKELY(ehashids_get_numbers(env, &scratch, head, len) == NULL)){
+            wide = 0;
+            size = ehashids_encoded_size_max(ctx, len);
+        } else {
+            reason = ehashids_get_bignums(env, &bignums, flat ? enif_make_list1(env, head) : head, len);
+            if(EHASHIDS_UNLIKELY(reason != NULL)) break;
+            wide = 1;
+            size = ehashids_big_encoded_size_max(ctx, &bignums);
+        }
+#ifdef EHASHIDS_DIRTY_NIFS
+        if(EHASHIDS_UNLIKELY(!dirty && (size > EHASHIDS_DIRTY_BYTES || bignums.width * 32 > EHASHIDS_DIRTY_BIG_BITS))){
+            ehashids_bignums_free(&bignums);
+            ehashids_scratch_done(env, ctx, &scratch);
+            next_argv[0] = argv[0];
+            next_argv[1] = list;
+            next_argv[2] = acc;
+            return enif_schedule_nif(
+                env,
+                flat ? "encode_many_one" : "encode_many",
+                ERL_NIF_DIRTY_JOB_CPU_BOUND,
+                flat ? hashids_encode_many_one_dirty_nif : hashids_encode_many_dirty_nif,
+                3,
+                next_argv
+            );
+        }
+#endif
+
+        if(EHASHIDS_LIKELY(!wide)){
+            reason = ehashids_encode_numbers(env, ctx, &scratch, len, &bin);
+        } else {
+            reason = ehashids_encode_bignums(env, ctx, &scratch, &bignums, &bin);
+            ehashids_bignums_free(&bignums);
+        }
+        if(EHASHIDS_UNLIKELY(reason != NULL)) break;
+
+        acc = enif_make_list_cell(env, bin, acc);
+        list = tail;
+
+        work += size;
+        if(EHASHIDS_UNLIKELY(!dirty && work >= EHASHIDS_BATCH_CHECK_BYTES)){
+            work = 0;
+            if(!ehashids_consume_timeslice(env, &last)) continue;
+            ehashids_scratch_done(env, ctx, &scratch);
+            next_argv[0] = argv[0];
+            next_argv[1] = list;
+            next_argv[2] = acc;
+            return enif_schedule_nif(
+                env,
+                flat ? "encode_many_one" : "encode_many",
+                0,
+                flat ? hashids_encode_many_one_continue_nif : hashids_encode_many_continue_nif,
+                3,
+                next_argv
+            );
+        }
+    }
+    ehashids_bignums_free(&bignums);
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+    if(EHASHIDS_UNLIKELY(!enif_is_empty_list(env, list))) return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+
+    if(!dirty) (void)ehashids_consume_timeslice(env, &last);
+    (void)enif_make_reverse_list(env, acc, &result);
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), result);
+}
+
+static ERL_NIF_TERM hashids_encode_many_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ERL_NIF_TERM start_argv[3];
+
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    start_argv[0] = argv[0];
+    start_argv[1] = argv[1];
+    start_argv[2] = enif_make_list(env, 0);
+    return ehashids_encode_many(env, start_argv, 0, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_many_continue_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_many(env, argv, 0, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_many_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_many(env, argv, 0, 1);
+}
+
+static ERL_NIF_TERM hashids_encode_many_one_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ERL_NIF_TERM start_argv[3];
+
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    start_argv[0] = argv[0];
+    start_argv[1] = argv[1];
+    start_argv[2] = enif_make_list(env, 0);
+    return ehashids_encode_many(env, start_argv, 1, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_many_one_continue_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_many(env, argv, 1, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_many_one_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_many(env, argv, 1, 1);
+}
+
+/*
+ * encode_range/3. The lottery of a single number only depends on the number
+ * modulo 100, so a range has at most min(100, alphabet length) of them and
+ * everything derived from the lottery alone is worked out once per range:
+ * the alphabet after the first shuffle and the alphabets of the padding
+ * wraps. They are kept in a state binary, a row of depth alphabets per
+ * lottery position, handed from one slice of the range to the next. The
+ * digits of the numbers are kept in base alphabet length and counted up
+ * instead of divided out for every number.
+ */
+static size_t ehashids_range_rows(const ehashids_t *ctx)
+{
+    return ctx->hashids.alphabet_length < 100 ? ctx->hashids.alphabet_length : 100;
+}
+
+// Fills the state row of the lottery at position row
+static void ehashids_range_fill(const ehashids_t *ctx, char *state, size_t depth, size_t row)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    size_t alphabet_length = hashids->alphabet_length;
+    char *alphabet = state + row * depth * alphabet_length;
+    char salt[EHASHIDS_MAX_ALPHABET];
+
+    ehashids_first_shuffle(ctx, alphabet, salt, hashids->alphabet[row], NULL);
+    for(size_t i = 1; i < depth; i++, alphabet += alphabet_length){
+        (void)memcpy(alphabet + alphabet_length, alphabet, alphabet_length);
+        ehashids_shuffle(alphabet + alphabet_length, alphabet_length, alphabet, alphabet_length);
+    }
+}
+
+// Same as ehashids_encode_one() for a number given by its digits, least significant first
+static size_t ehashids_encode_range_one(const ehashids_t *ctx, const char *state, size_t depth, char *buffer, unsigned long long number, const unsigned char *digits, size_t digits_count)
+{
+    const hashids_t *hashids = &ctx->hashids;
+    size_t alphabet_length = hashids->alphabet_length;
+    unsigned long long numbers_hash = number % 100;
+    size_t row = numbers_hash % alphabet_length;
+    const char *row_alphabet = state + row * depth * alphabet_length;
+    char alphabet[EHASHIDS_MAX_ALPHABET];
+    char scratch[EHASHIDS_MAX_ALPHABET];
+    size_t len = digits_count + 1;
+
+    buffer[0] = hashids->alphabet[row];
+    for(size_t i = 0; i < digits_count; i++){
+        buffer[len - 1 - i] = row_alphabet[digits[i]];
+    }
+
+    if(len < hashids->min_hash_length){
+        (void)memcpy(alphabet, row_alphabet, alphabet_length);
+        return ehashids_pad(hashids, buffer, len, numbers_hash, alphabet, scratch, row_alphabet + alphabet_length, depth - 1);
+    }
+
+    return len;
+}
+
+static ERL_NIF_TERM ehashids_encode_range(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ErlNifBinary state;
+    ErlNifUInt64 next;
+    ErlNifUInt64 remaining;
+    ERL_NIF_TERM acc = argv[4];
+    ERL_NIF_TERM bin;
+    ERL_NIF_TERM result;
+    ERL_NIF_TERM next_argv[5];
+    ErlNifTime last;
+    unsigned char digits[64];
+    unsigned long long number;
+    unsigned char *data;
+    size_t digits_count = 0;
+    size_t alphabet_length;
+    size_t depth;
+    size_t size_max;
+    size_t batch;
+    size_t pos;
+    size_t i;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, argv[1], &next) || !enif_get_uint64(env, argv[2], &remaining) ||
+                         !enif_inspect_binary(env, argv[3], &state))){
+        return ehashids_error(env, EHASHIDS_ATOM_BADARG);
+    }
+
+    alphabet_length = ctx->hashids.alphabet_length;
+    depth = state.size / (ehashids_range_rows(ctx) * alphabet_length);
+    size_max = ehashids_encoded_size_max(ctx, 1);
+    // a batch is about as much work as one id that would still be encoded inline
+    batch = EHASHIDS_DIRTY_BYTES / size_max;
+    if(batch == 0) batch = 1;
+    if(batch > EHASHIDS_RANGE_BATCH) batch = EHASHIDS_RANGE_BATCH;
+
+    number = next;
+    do {
+        digits[digits_count++] = (unsigned char)(number % alphabet_length);
+        number /= alphabet_length;
+    } while(number);
+
+    last = enif_monotonic_time(ERL_NIF_USEC);
+    ehashids_scratch_init(&scratch);
+
+    while(remaining > 0){
+        if(remaining < batch) batch = (size_t)remaining;
+        if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(&scratch, batch, batch * size_max))){
+            ehashids_scratch_done(env, ctx, &scratch);
+            return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+        }
+
+        for(i = 0, pos = 0; i < batch; i++, next++){
+            scratch.numbers[i] = ehashids_encode_range_one(ctx, (const char *)state.data, depth, scratch.buffer + pos,
+                                                           next, digits, digits_count);
+            pos += scratch.numbers[i];
+
+            // count up to the next number
+            for(size_t d = 0; ; d++){
+                if(d == digits_count){
+                    digits[digits_count++] = 1;
+                    break;
+                }
+                if(digits[d] + 1u < alphabet_length){
+                    digits[d]++;
+                    break;
+                }
+                digits[d] = 0;
+            }
+        }
+
+        data = enif_make_new_binary(env, pos, &bin);
+        if(EHASHIDS_UNLIKELY(data == NULL)){
+            ehashids_scratch_done(env, ctx, &scratch);
+            return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+        }
+        (void)memcpy(data, scratch.buffer, pos);
+        for(i = 0, pos = 0; i < batch; pos += scratch.numbers[i], i++){
+            acc = enif_make_list_cell(env, enif_make_sub_binary(env, bin, pos, scratch.numbers[i]), acc);
+        }
+        scratch.tally.counts[EHASHIDS_STAT_ENCODE] += batch;
+        scratch.tally.counts[EHASHIDS_STAT_BYTES] += pos;
+        remaining -= batch;
+
+        // on a dirty scheduler the whole range is done in one go
+        if(remaining > 0 && !dirty && ehashids_consume_timeslice(env, &last)){
+            ehashids_scratch_done(env, ctx, &scratch);
+            next_argv[0] = argv[0];
+            next_argv[1] = enif_make_uint64(env, next);
+            next_argv[2] = enif_make_uint64(env, remaining);
+            next_argv[3] = argv[3];
+            next_argv[4] = acc;
+            return enif_schedule_nif(env, "encode_range", 0, hashids_encode_range_continue_nif, 5, next_argv);
+        }
+    }
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(!dirty) (void)ehashids_consume_timeslice(env, &last);
+    (void)enif_make_reverse_list(env, acc, &result);
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), result);
+}
+
+static ERL_NIF_TERM ehashids_encode_range_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ErlNifUInt64 from;
+    ErlNifUInt64 count;
+    ERL_NIF_TERM start_argv[5];
+    size_t alphabet_length;
+    size_t min_hash_length;
+    size_t rows;
+    size_t depth = 1;
+    char *state;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, argv[1], &from))){
+        return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+    }
+    if(EHASHIDS_UNLIKELY(!enif_get_uint64(env, argv[2], &count))){
+        return make_error_tuple_from_string(env, "count");
+    }
+    // the last number has to fit in 64 bits as well
+    if(EHASHIDS_UNLIKELY(count > 0 && from + (count - 1) < from)){
+        return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+    }
+
+    // ids that encode_one/2 would make dirty, the lottery state included
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && count > 0 && ehashids_encoded_size_max(ctx, 1) > EHASHIDS_DIRTY_BYTES)){
+        return enif_schedule_nif(env, "encode_range", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_encode_range_dirty_nif, 3, argv);
+    }
+#endif
+
+    alphabet_length = ctx->hashids.alphabet_length;
+    min_hash_length = ctx->hashids.min_hash_length;
+    rows = ehashids_range_rows(ctx);
+
+    // the shortest id is the lottery and one digit, with both guards every wrap adds up to an alphabet
+    if(min_hash_length > 3){
+        depth += (min_hash_length - 3 + alphabet_length - 1) / alphabet_length;
+    }
+    if(rows * depth * alphabet_length > EHASHIDS_RANGE_STATE_MAX){
+        depth = EHASHIDS_RANGE_STATE_MAX / (rows * alphabet_length);
+    }
+
+    state = (char *)enif_make_new_binary(env, rows * depth * alphabet_length, &start_argv[3]);
+    if(EHASHIDS_UNLIKELY(state == NULL)) return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+
+    // only the lotteries the range goes through
+    if(count >= 100){
+        for(size_t row = 0; row < rows; row++) ehashids_range_fill(ctx, state, depth, row);
+    } else {
+        for(unsigned int i = 0; i < count; i++) ehashids_range_fill(ctx, state, depth, (from % 100 + i) % 100 % alphabet_length);
+    }
+
+    start_argv[0] = argv[0];
+    start_argv[1] = argv[1];
+    start_argv[2] = argv[2];
+    start_argv[4] = enif_make_list(env, 0);
+    return ehashids_encode_range(env, start_argv, dirty);
+}
+
+static ERL_NIF_TERM hashids_encode_range_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 3)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_encode_range_call(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_range_continue_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_range(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_range_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_range_call(env, argv, 1);
+}
+
+/*
+ * Response building. Every item is encoded straight into one output binary,
+ * sized up front from the bound of each item and shrunk once at the end, so
+ * a page of ids costs a single binary allocation instead of one per id. The
+ * options map holds iodata for the separator, quote, prefix and suffix.
+ */
+typedef struct {
+    ErlNifBinary separator;
+    ErlNifBinary quote;
+    ErlNifBinary prefix;
+    ErlNifBinary suffix;
+    int offsets;
+} ehashids_into_opts_t;
+
+static int ehashids_get_into_opt(ErlNifEnv *env, ERL_NIF_TERM map, const char *key, ErlNifBinary *out)
+{
+    ERL_NIF_TERM value;
+
+    out->data = NULL;
+    out->size = 0;
+
+    if(!enif_get_map_value(env, map, make_atom(env, key), &value)) return 1;
+
+    return enif_inspect_iolist_as_binary(env, value, out);
+}
+
+static int ehashids_get_into_opts(ErlNifEnv *env, ERL_NIF_TERM map, ehashids_into_opts_t *opts)
+{
+    ERL_NIF_TERM value;
+
+    if(!enif_is_map(env, map)) return 0;
+
+    if(!ehashids_get_into_opt(env, map, "separator", &opts->separator) ||
+       !ehashids_get_into_opt(env, map, "quote", &opts->quote) ||
+       !ehashids_get_into_opt(env, map, "prefix", &opts->prefix) ||
+       !ehashids_get_into_opt(env, map, "suffix", &opts->suffix)){
+        return 0;
+    }
+
+    opts->offsets = 0;
+    if(enif_get_map_value(env, map, make_atom(env, "offsets"), &value)){
+        if(enif_is_identical(value, ehashids_atom(env, EHASHIDS_ATOM_TRUE))) opts->offsets = 1;
+        else if(!enif_is_identical(value, ehashids_atom(env, EHASHIDS_ATOM_FALSE))) return 0;
+    }
+
+    return 1;
+}
+
+static size_t ehashids_put(ErlNifBinary *out, size_t pos, const ErlNifBinary *bin)
+{
+    if(bin->size > 0) (void)memcpy(out->data + pos, bin->data, bin->size);
+    return pos + bin->size;
+}
+
+/*
+ * Upper bound of the id of an item of encode_into/3, a list of len numbers.
+ * 64 bit numbers are bounded by their count, an item holding a wider one is
+ * read as integers of any size and bounded by its limbs like encode/2 does.
+ * *wide is set when encode/2 would move the item to a dirty scheduler for
+ * its width alone.
+ */
+static const char *ehashids_into_size_max(ErlNifEnv *env, const ehashids_t *ctx, ERL_NIF_TERM list, unsigned int len, size_t *size, int *wide)
+{
+    ehashids_bignums_t b;
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+    ERL_NIF_TERM rest = list;
+    ErlNifUInt64 number;
+    const char *reason;
+    unsigned int i;
+
+    for(i = 0; i < len && enif_get_list_cell(env, rest, &head, &tail) && enif_get_uint64(env, head, &number); i++){
+        rest = tail;
+    }
+    if(EHASHIDS_LIKELY(i == len)){
+        *size = ehashids_encoded_size_max(ctx, len);
+        *wide = 0;
+        return NULL;
+    }
+
+    ehashids_bignums_init(&b);
+    reason = ehashids_get_bignums(env, &b, list, len);
+    if(EHASHIDS_LIKELY(reason == NULL)){
+        *size = ehashids_big_encoded_size_max(ctx, &b);
+        *wide = b.width * 32 > EHASHIDS_DIRTY_BIG_BITS;
+    }
+    ehashids_bignums_free(&b);
+
+    return reason;
+}
+
+// Encodes one item wider than 64 bits at pos, out already holds its bound, returns an error reason or NULL
+static const char *ehashids_encode_into_big(ErlNifEnv *env, const ehashids_t *ctx, ERL_NIF_TERM list, unsigned int len, ErlNifBinary *out, size_t *pos)
+{
+    ehashids_bignums_t b;
+    const char *reason;
+    size_t size;
+
+    ehashids_bignums_init(&b);
+    reason = ehashids_get_bignums(env, &b, list, len);
+    if(EHASHIDS_UNLIKELY(reason != NULL)) goto done;
+
+    reason = "alloc";
+    b.work = (uint32_t *)enif_alloc(sizeof(uint32_t) * (b.width ? b.width : 1));
+    if(EHASHIDS_UNLIKELY(b.work == NULL)) goto done;
+
+    reason = "numbers";
+    size = ehashids_encode_big(ctx, (char *)out->data + *pos, &b);
+    if(EHASHIDS_UNLIKELY(size == 0)) goto done;
+
+    *pos += size;
+    reason = NULL;
+
+done:
+    ehashids_bignums_free(&b);
+    return reason;
+}
+
+static ERL_NIF_TERM ehashids_encode_into_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ehashids_into_opts_t opts;
+    ErlNifBinary out;
+    ERL_NIF_TERM list;
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+    ERL_NIF_TERM bin;
+    ERL_NIF_TERM offsets;
+    const char *reason = NULL;
+    size_t *positions = NULL;
+    unsigned int items;
+    unsigned int len;
+    unsigned int i;
+    size_t size;
+    size_t item_size;
+    size_t pos;
+    size_t start;
+    int wide = 0;
+    int item_wide;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_into_opts(env, argv[2], &opts))){
+        return make_error_tuple_from_string(env, "options");
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, argv[1], &items))){
+        return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+    }
+
+    // an item is a number or a list of numbers, sum up the bound of each
+    size = opts.prefix.size + opts.suffix.size + (items > 0 ? (size_t)(items - 1) * opts.separator.size : 0);
+    for(list = argv[1]; enif_get_list_cell(env, list, &head, &tail); list = tail){
+        if(enif_is_list(env, head)){
+            if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, head, &len))){
+                return ehashids_error(env, EHASHIDS_ATOM_NUMBERS);
+            }
+        } else {
+            len = 1;
+            head = enif_make_list1(env, head);
+        }
+        reason = ehashids_into_size_max(env, ctx, head, len, &item_size, &item_wide);
+        if(EHASHIDS_UNLIKELY(reason != NULL)) break;
+        size += 2 * opts.quote.size + item_size;
+        wide |= item_wide;
+    }
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)){
+        ehashids_scratch_init(&scratch);
+        ehashids_tally_result(&scratch.tally, reason);
+        ehashids_scratch_done(env, ctx, &scratch);
+        return make_error_tuple_from_string(env, reason);
+    }
+
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && (wide || size > EHASHIDS_DIRTY_INTO_BYTES))){
+        return enif_schedule_nif(env, "encode_into", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_encode_into_dirty_nif, 3, argv);
+    }
+#endif
+
+    if(EHASHIDS_UNLIKELY(!enif_alloc_binary(size, &out))){
+        return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+    }
+    if(opts.offsets){
+        positions = (size_t *)enif_alloc(sizeof(size_t) * 2 * (items > 0 ? items : 1));
+        if(EHASHIDS_UNLIKELY(positions == NULL)){
+            enif_release_binary(&out);
+            return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+        }
+    }
+
+    ehashids_scratch_init(&scratch);
+    pos = ehashids_put(&out, 0, &opts.prefix);
+
+    for(i = 0, list = argv[1]; enif_get_list_cell(env, list, &head, &tail); i++, list = tail){
+        if(i > 0) pos = ehashids_put(&out, pos, &opts.separator);
+        pos = ehashids_put(&out, pos, &opts.quote);
+        start = pos;
+
+        if(enif_is_list(env, head)){
+            (void)enif_get_list_length(env, head, &len);
+        } else {
+            len = 1;
+            head = enif_make_list1(env, head);
+        }
+
+        // the bound of the item is already part of size, wide or not
+        if(EHASHIDS_LIKELY(ehashids_get_numbers(env, &scratch, head, len) == NULL)){
+            len = (unsigned int)ehashids_encode(ctx, (char *)out.data + pos, len, scratch.numbers);
+            if(EHASHIDS_UNLIKELY(len == 0)){
+                reason = "numbers";
+                break;
+            }
+            pos += len;
+        } else {
+            reason = ehashids_encode_into_big(env, ctx, head, len, &out, &pos);
+            if(EHASHIDS_UNLIKELY(reason != NULL)) break;
+            scratch.tally.counts[EHASHIDS_STAT_WIDE]++;
+        }
+        scratch.tally.counts[EHASHIDS_STAT_ENCODE]++;
+
+        if(positions){
+            positions[2 * i] = start;
+            positions[2 * i + 1] = pos - start;
+        }
+        pos = ehashids_put(&out, pos, &opts.quote);
+    }
+    scratch.tally.counts[EHASHIDS_STAT_BYTES] += pos;
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)){
+        enif_release_binary(&out);
+        if(positions) enif_free(positions);
+        return make_error_tuple_from_string(env, reason);
+    }
+
+    pos = ehashids_put(&out, pos, &opts.suffix);
+    (void)enif_realloc_binary(&out, pos);
+    bin = enif_make_binary(env, &out);
+
+    if(positions == NULL) return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), bin);
+
+    offsets = enif_make_list(env, 0);
+    while(i > 0){
+        i--;
+        offsets = enif_make_list_cell(
+            env,
+            enif_make_tuple2(env, enif_make_uint64(env, positions[2 * i]), enif_make_uint64(env, positions[2 * i + 1])),
+            offsets
+        );
+    }
+    enif_free(positions);
+
+    return enif_make_tuple3(env, ehashids_atom(env, EHASHIDS_ATOM_OK), bin, offsets);
+}
+
+static ERL_NIF_TERM hashids_encode_into_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 3)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_encode_into_call(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_encode_into_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_encode_into_call(env, argv, 1);
+}
+
+static ERL_NIF_TERM ehashids_decode_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int safe, int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ErlNifBinary id_bin;
+    const char *reason;
+    ERL_NIF_TERM result;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_inspect_binary(env, argv[1], &id_bin))){
+        return ehashids_error(env, EHASHIDS_ATOM_ID);
+    }
+
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && id_bin.size > EHASHIDS_DIRTY_BYTES)){
+        return enif_schedule_nif(
+            env,
+            safe ? "decode_safe" : "decode",
+            ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            safe ? hashids_decode_safe_dirty_nif : hashids_decode_dirty_nif,
+            2,
+            argv
+        );
+    }
+#endif
+
+    ehashids_scratch_init(&scratch);
+    reason = ehashids_decode_binary(env, ctx, &scratch, &id_bin, safe, &result);
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), result);
+}
+
+static ERL_NIF_TERM hashids_decode_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_decode_call(env, argv, 0, 0);
+}
+
+static ERL_NIF_TERM hashids_decode_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_decode_call(env, argv, 0, 1);
+}
+
+static ERL_NIF_TERM hashids_decode_safe_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_decode_call(env, argv, 1, 0);
+}
+
+static ERL_NIF_TERM hashids_decode_safe_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_decode_call(env, argv, 1, 1);
+}
+
+static ERL_NIF_TERM hashids_new_keyring_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *keys[EHASHIDS_KEYRING_MAX];
+    ehashids_keyring_t *keyring;
+    ERL_NIF_TERM list = argv[0];
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM result;
+    unsigned int count;
+    size_t i;
+
+    if(EHASHIDS_UNLIKELY(argc != 1)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    if(EHASHIDS_UNLIKELY(!enif_get_list_length(env, list, &count) || count == 0 || count > EHASHIDS_KEYRING_MAX)){
+        return make_error_tuple_from_string(env, "keys");
+    }
+
+    for(i = 0; i < count; i++){
+        (void)enif_get_list_cell(env, list, &head, &list);
+        if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, head, &keys[i]))){
+            return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+        }
+    }
+
+    keyring = (ehashids_keyring_t *)enif_alloc_resource(keyring_type, sizeof(ehashids_keyring_t) + count * sizeof(ehashids_t *));
+    if(EHASHIDS_UNLIKELY(keyring == NULL)) return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+
+    keyring->count = count;
+    for(i = 0; i < count; i++){
+        enif_keep_resource(keys[i]);
+        keyring->keys[i] = keys[i];
+    }
+
+    result = enif_make_resource(env, keyring);
+    enif_release_resource(keyring);
+
+    return result;
+}
+
+/*
+ * decode_safe/2 against every key of a keyring in turn, the first one that
+ * accepts the id wins. Keys whose alphabet, separators and guards don't
+ * cover every character of the id are skipped without decoding, only the
+ * keys actually tried count a decode. When no key accepts the id the error
+ * is unsafe if some key could read it, invalid_hash otherwise.
+ */
+static ERL_NIF_TERM ehashids_decode_any_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_keyring_t *keyring = NULL;
+    ehashids_t *ctx;
+    ehashids_scratch_t scratch;
+    ErlNifBinary id_bin;
+    const char *reason;
+    const char *failure = "invalid_hash";
+    ERL_NIF_TERM result;
+    size_t i;
+
+    if(EHASHIDS_UNLIKELY(!enif_get_resource(env, argv[0], keyring_type, (void **)&keyring))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_inspect_binary(env, argv[1], &id_bin))){
+        return ehashids_error(env, EHASHIDS_ATOM_ID);
+    }
+
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && id_bin.size > EHASHIDS_DIRTY_BYTES)){
+        return enif_schedule_nif(env, "decode_any", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_decode_any_dirty_nif, 2, argv);
+    }
+#endif
+
+    for(i = 0; i < keyring->count; i++){
+        // keys taken over from an older library may need a rebuild too
+        ctx = ehashids_context_of(env, keyring->keys[i]);
+        if(EHASHIDS_UNLIKELY(ctx == NULL) || !ehashids_valid(ctx, id_bin.data, id_bin.size)) continue;
+
+        ehashids_scratch_init(&scratch);
+        reason = ehashids_decode_binary(env, ctx, &scratch, &id_bin, 1, &result);
+        ehashids_tally_result(&scratch.tally, reason);
+        ehashids_scratch_done(env, ctx, &scratch);
+
+        if(reason == NULL){
+            return enif_make_tuple3(
+                env,
+                ehashids_atom(env, EHASHIDS_ATOM_OK),
+                enif_make_uint64(env, (ErlNifUInt64)(i + 1)),
+                result
+            );
+        }
+        if(EHASHIDS_UNLIKELY(strcmp(reason, "alloc") == 0)) return make_error_tuple_from_string(env, reason);
+        if(strcmp(reason, "invalid_hash") != 0) failure = reason;
+    }
+
+    return make_error_tuple_from_string(env, failure);
+}
+
+static ERL_NIF_TERM hashids_decode_any_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_decode_any_call(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_decode_any_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_decode_any_call(env, argv, 1);
+}
+
+static ERL_NIF_TERM ehashids_decode_one_call(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ErlNifBinary id_bin;
+    const char *reason;
+    ERL_NIF_TERM result;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_inspect_binary(env, argv[1], &id_bin))){
+        return ehashids_error(env, EHASHIDS_ATOM_ID);
+    }
+
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(EHASHIDS_UNLIKELY(!dirty && id_bin.size > EHASHIDS_DIRTY_BYTES)){
+        return enif_schedule_nif(env, "decode_one", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_decode_one_dirty_nif, 2, argv);
+    }
+#endif
+
+    ehashids_scratch_init(&scratch);
+    reason = ehashids_decode_one(env, ctx, &scratch, &id_bin, &result);
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), result);
+}
+
+static ERL_NIF_TERM hashids_decode_one_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_decode_one_call(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_decode_one_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_decode_one_call(env, argv, 1);
+}
+
+/*
+ * Batch decoding, yields the same way as ehashids_encode_many(). A bad id
+ * only produces an error tuple in its own slot of the result.
+ */
+static ERL_NIF_TERM ehashids_decode_many(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ERL_NIF_TERM list = argv[1];
+    ERL_NIF_TERM acc = argv[2];
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail;
+    ERL_NIF_TERM item;
+    ERL_NIF_TERM result;
+    ERL_NIF_TERM next_argv[3];
+    ErlNifBinary id_bin;
+    ErlNifTime last;
+    const char *reason;
+    size_t work = 0;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    last = enif_monotonic_time(ERL_NIF_USEC);
+    ehashids_scratch_init(&scratch);
+
+    while(enif_get_list_cell(env, list, &head, &tail)){
+        if(EHASHIDS_LIKELY(enif_inspect_binary(env, head, &id_bin))){
+#ifdef EHASHIDS_DIRTY_NIFS
+            if(EHASHIDS_UNLIKELY(!dirty && id_bin.size > EHASHIDS_DIRTY_BYTES)){
+                ehashids_scratch_done(env, ctx, &scratch);
+                next_argv[0] = argv[0];
+                next_argv[1] = list;
+                next_argv[2] = acc;
+                return enif_schedule_nif(env, "decode_many", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_decode_many_dirty_nif, 3, next_argv);
+            }
+#endif
+            work += id_bin.size;
+            reason = ehashids_decode_binary(env, ctx, &scratch, &id_bin, 0, &result);
+        } else {
+            reason = "id";
+        }
+        if(EHASHIDS_LIKELY(reason == NULL)){
+            item = enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), result);
+        } else {
+            ehashids_tally_result(&scratch.tally, reason);
+            item = make_error_tuple_from_string(env, reason);
+        }
+
+        acc = enif_make_list_cell(env, item, acc);
+        list = tail;
+
+        if(EHASHIDS_UNLIKELY(!dirty && work >= EHASHIDS_BATCH_CHECK_BYTES)){
+            work = 0;
+            if(!ehashids_consume_timeslice(env, &last)) continue;
+            ehashids_scratch_done(env, ctx, &scratch);
+            next_argv[0] = argv[0];
+            next_argv[1] = list;
+            next_argv[2] = acc;
+            return enif_schedule_nif(env, "decode_many", 0, hashids_decode_many_continue_nif, 3, next_argv);
+        }
+    }
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(!enif_is_empty_list(env, list))) return ehashids_error(env, EHASHIDS_ATOM_IDS);
+
+    if(!dirty) (void)ehashids_consume_timeslice(env, &last);
+    (void)enif_make_reverse_list(env, acc, &result);
+    return result;
+}
+
+static ERL_NIF_TERM hashids_decode_many_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    ERL_NIF_TERM start_argv[3];
+
+    if(EHASHIDS_UNLIKELY(argc != 2)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    start_argv[0] = argv[0];
+    start_argv[1] = argv[1];
+    start_argv[2] = enif_make_list(env, 0);
+    return ehashids_decode_many(env, start_argv, 0);
+}
+
+static ERL_NIF_TERM hashids_decode_many_continue_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_decode_many(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_decode_many_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_decode_many(env, argv, 1);
+}
+
+/*
+ * Bulk transcoding of delimiter separated tokens, see ehashids_bulk. A chunk
+ * is either decimal numbers to encode or ids to decode, every output token is
+ * followed by the delimiter so the outputs of consecutive chunks can simply
+ * be concatenated. Empty tokens are skipped and so is a carriage return
+ * ending a token when the delimiter is a newline.
+ */
+
+// Parses a decimal 64 bit number, returns 0 when it is not one
+static int ehashids_parse_uint64(const unsigned char *p, size_t len, unsigned long long *out)
+{
+    unsigned long long number = 0;
+    unsigned int digit;
+    size_t i;
+
+    if(EHASHIDS_UNLIKELY(len == 0)) return 0;
+
+    for(i = 0; i < len; i++){
+        digit = (unsigned int)(p[i] - '0');
+        if(EHASHIDS_UNLIKELY(digit > 9)) return 0;
+        if(EHASHIDS_UNLIKELY(number > (ULLONG_MAX - digit) / 10)) return 0;
+        number = number * 10 + digit;
+    }
+
+    *out = number;
+    return 1;
+}
+
+// Decodes one token as a canonical id of a single 64 bit number, returns an error reason or NULL
+static const char *ehashids_transcode_decode(const ehashids_t *ctx, ehashids_scratch_t *scratch, const unsigned char *p, size_t len, unsigned long long *out)
+{
+    ehashids_bignums_t b;
+    const char *reason;
+    const char *start;
+    const char *end;
+    size_t encoded;
+
+    scratch->tally.counts[EHASHIDS_STAT_DECODE]++;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_valid(ctx, p, len))) return "invalid_hash";
+    if(EHASHIDS_UNLIKELY(ehashids_numbers_count(ctx, (const char *)p, len, &start, &end) != 1)) return "invalid_hash";
+    if(EHASHIDS_UNLIKELY(!ehashids_decode(ctx, start, end, out))){
+        // ehashids_decode() gives up a little before 2^64, read it exactly
+        ehashids_bignums_init(&b);
+        reason = ehashids_decode_big(ctx, start, end, 1, &b);
+        if(reason == NULL && b.limbs_count > 2) reason = "numbers";
+        if(reason == NULL){
+            *out = b.limbs_count > 0 ? b.limbs[0] : 0;
+            if(b.limbs_count > 1) *out |= (unsigned long long)b.limbs[1] << 32;
+        }
+        ehashids_bignums_free(&b);
+        if(reason != NULL) return reason;
+    }
+
+    encoded = ehashids_encode_one(ctx, scratch->buffer, *out);
+    if(encoded != len || memcmp(scratch->buffer, p, len) != 0) return "unsafe";
+
+    return NULL;
+}
+
+static ERL_NIF_TERM ehashids_transcode_chunk(ErlNifEnv* env, const ERL_NIF_TERM argv[], int dirty)
+{
+    ehashids_t *ctx = NULL;
+    ehashids_scratch_t scratch;
+    ErlNifBinary chunk;
+    ErlNifBinary out;
+    const unsigned char *p;
+    const unsigned char *stop;
+    const unsigned char *token;
+    const char *reason = NULL;
+    unsigned long long number;
+    unsigned int delimiter;
+    size_t tokens = 1;
+    size_t items = 0;
+    size_t token_max;
+    size_t len;
+    size_t pos = 0;
+    char digits[20];
+    char *d;
+    int encode;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(enif_is_identical(argv[1], ehashids_atom(env, EHASHIDS_ATOM_ENCODE))) encode = 1;
+    else if(enif_is_identical(argv[1], ehashids_atom(env, EHASHIDS_ATOM_DECODE))) encode = 0;
+    else return make_error_tuple_from_string(env, "direction");
+
+    if(EHASHIDS_UNLIKELY(!enif_inspect_binary(env, argv[2], &chunk))){
+        return make_error_tuple_from_string(env, "chunk");
+    }
+
+    // the delimiter can be neither a digit nor part of an id
+    if(EHASHIDS_UNLIKELY(!enif_get_uint(env, argv[3], &delimiter) || delimiter > 255 ||
+                         (delimiter >= '0' && delimiter <= '9') || ctx->classes[delimiter] != EHASHIDS_CLASS_INVALID)){
+        return make_error_tuple_from_string(env, "delimiter");
+    }
+
+#ifdef EHASHIDS_DIRTY_NIFS
+    if(!dirty){
+        return enif_schedule_nif(env, "transcode_chunk", ERL_NIF_DIRTY_JOB_CPU_BOUND, hashids_transcode_chunk_dirty_nif, 4, argv);
+    }
+#endif
+
+    stop = chunk.data + chunk.size;
+    for(p = chunk.data; (p = memchr(p, (int)delimiter, (size_t)(stop - p))) != NULL; p++) tokens++;
+
+    // every output token is followed by the delimiter
+    token_max = encode ? ehashids_encoded_size_max(ctx, 1) : sizeof(digits);
+    if(EHASHIDS_UNLIKELY(!enif_alloc_binary(tokens * (token_max + 1), &out))){
+        return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+    }
+
+    ehashids_scratch_init(&scratch);
+    if(EHASHIDS_UNLIKELY(!ehashids_scratch_reserve(&scratch, 0, ehashids_encoded_size_max(ctx, 1)))){
+        reason = "alloc";
+    }
+
+    for(token = chunk.data; reason == NULL && token < stop; token = p + 1){
+        p = memchr(token, (int)delimiter, (size_t)(stop - token));
+        if(p == NULL) p = stop;
+
+        len = (size_t)(p - token);
+        if(len > 0 && delimiter == '\n' && token[len - 1] == '\r') len--;
+        if(len == 0) continue;
+
+        if(encode){
+            if(EHASHIDS_UNLIKELY(!ehashids_parse_uint64(token, len, &number))){
+                reason = "numbers";
+                break;
+            }
+            pos += ehashids_encode_one(ctx, (char *)out.data + pos, number);
+            scratch.tally.counts[EHASHIDS_STAT_ENCODE]++;
+        } else {
+            reason = ehashids_transcode_decode(ctx, &scratch, token, len, &number);
+            if(EHASHIDS_UNLIKELY(reason != NULL)) break;
+
+            d = digits + sizeof(digits);
+            do {
+                *--d = (char)('0' + number % 10);
+                number /= 10;
+            } while(number);
+            (void)memcpy(out.data + pos, d, (size_t)(digits + sizeof(digits) - d));
+            pos += (size_t)(digits + sizeof(digits) - d);
+        }
+        out.data[pos++] = (unsigned char)delimiter;
+        items++;
+    }
+
+    scratch.tally.counts[EHASHIDS_STAT_BYTES] += out.size;
+    ehashids_tally_result(&scratch.tally, reason);
+    ehashids_scratch_done(env, ctx, &scratch);
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)){
+        enif_release_binary(&out);
+        return make_error_tuple(
+            env,
+            enif_make_tuple2(env, make_atom(env, reason), enif_make_uint64(env, (ErlNifUInt64)(token - chunk.data)))
+        );
+    }
+
+    (void)enif_realloc_binary(&out, pos);
+    return enif_make_tuple3(env, ehashids_atom(env, EHASHIDS_ATOM_OK), enif_make_binary(env, &out), enif_make_uint64(env, (ErlNifUInt64)items));
+}
+
+static ERL_NIF_TERM hashids_transcode_chunk_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    if(EHASHIDS_UNLIKELY(argc != 4)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    return ehashids_transcode_chunk(env, argv, 0);
+}
+
+static ERL_NIF_TERM hashids_transcode_chunk_dirty_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_transcode_chunk(env, argv, 1);
+}
+
+static ERL_NIF_TERM hashids_new_from_compiled_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ErlNifBinary compiled_bin;
+    hashids_t source;
+    const char *reason;
+    ERL_NIF_TERM resource;
+
+    if(EHASHIDS_UNLIKELY(argc != 1)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    if(EHASHIDS_LIKELY(enif_inspect_binary(env, argv[0], &compiled_bin))){
+        reason = ehashids_unpack(&compiled_bin, &source);
+    } else {
+        reason = ehashids_unpack_legacy(env, argv[0], &source);
+    }
+
+    if(EHASHIDS_LIKELY(reason == NULL)){
+        reason = ehashids_make_resource(env, &source, &resource);
+    }
+
+    if(EHASHIDS_UNLIKELY(reason != NULL)) return make_error_tuple_from_string(env, reason);
+
+    return resource;
+}
+
+static ERL_NIF_TERM hashids_compile_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    const hashids_t *h;
+    ERL_NIF_TERM compiled;
+    unsigned char *data;
+    unsigned char *p;
+    size_t size;
+
+    if(EHASHIDS_UNLIKELY(argc != 1)) return ehashids_error(env, EHASHIDS_ATOM_ARITY);
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    h = &ctx->hashids;
+
+    if(EHASHIDS_UNLIKELY(h->salt_length > UINT32_MAX || h->min_hash_length > UINT32_MAX)){
+        return ehashids_error(env, EHASHIDS_ATOM_BADARG);
+    }
+
+    size = EHASHIDS_COMPILED_HEADER + h->alphabet_length + h->salt_length +
+           h->separators_count + h->guards_count + EHASHIDS_COMPILED_TRAILER;
+    data = enif_make_new_binary(env, size, &compiled);
+    if(EHASHIDS_UNLIKELY(data == NULL)) return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+
+    (void)memcpy(data, EHASHIDS_COMPILED_MAGIC, 4);
+    data[4] = EHASHIDS_COMPILED_VERSION;
+    data[5] = 0;
+    ehashids_put_le(data + 6, (uint32_t)h->alphabet_length, 2);
+    ehashids_put_le(data + 8, (uint32_t)h->separators_count, 2);
+    ehashids_put_le(data + 10, (uint32_t)h->guards_count, 2);
+    ehashids_put_le(data + 12, (uint32_t)h->salt_length, 4);
+    ehashids_put_le(data + 16, (uint32_t)h->min_hash_length, 4);
+
+    p = data + EHASHIDS_COMPILED_HEADER;
+    (void)memcpy(p, h->alphabet, h->alphabet_length);
+    p += h->alphabet_length;
+    (void)memcpy(p, h->salt, h->salt_length);
+    p += h->salt_length;
+    (void)memcpy(p, h->separators, h->separators_count);
+    p += h->separators_count;
+    (void)memcpy(p, h->guards, h->guards_count);
+    p += h->guards_count;
+    ehashids_put_le(p, ehashids_crc32(data, size - EHASHIDS_COMPILED_TRAILER), 4);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), compiled);
+}
+
+static ERL_NIF_TERM hashids_cache_info_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_cache_t *cache = &((ehashids_priv_t *)enif_priv_data(env))->shared->cache;
+    ERL_NIF_TERM keys[5];
+    ERL_NIF_TERM values[5];
+    ERL_NIF_TERM info;
+
+    keys[0] = make_atom(env, "size");
+    keys[1] = make_atom(env, "capacity");
+    keys[2] = make_atom(env, "hits");
+    keys[3] = make_atom(env, "misses");
+    keys[4] = make_atom(env, "evictions");
+
+    if(cache->capacity > 0) enif_mutex_lock(cache->lock);
+    values[0] = enif_make_uint64(env, (ErlNifUInt64)cache->size);
+    values[1] = enif_make_uint64(env, (ErlNifUInt64)cache->capacity);
+    values[2] = enif_make_uint64(env, (ErlNifUInt64)cache->hits);
+    values[3] = enif_make_uint64(env, (ErlNifUInt64)cache->misses);
+    values[4] = enif_make_uint64(env, (ErlNifUInt64)cache->evictions);
+    if(cache->capacity > 0) enif_mutex_unlock(cache->lock);
+
+    (void)enif_make_map_from_arrays(env, keys, values, 5, &info);
+    return info;
+}
+
+/*
+ * is_valid/2. Only the characters and the guard, lottery and separator
+ * structure of the id are checked, the numbers are not decoded.
+ */
+static ERL_NIF_TERM hashids_is_valid_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    ErlNifBinary id_bin;
+    const char *start;
+    const char *end;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_inspect_binary(env, argv[1], &id_bin))){
+        return ehashids_error(env, EHASHIDS_ATOM_ID);
+    }
+
+    if(ehashids_valid(ctx, id_bin.data, id_bin.size) &&
+       ehashids_numbers_count(ctx, (const char *)id_bin.data, id_bin.size, &start, &end) != 0){
+        return ehashids_atom(env, EHASHIDS_ATOM_TRUE);
+    }
+
+    return ehashids_atom(env, EHASHIDS_ATOM_FALSE);
+}
+
+static ERL_NIF_TERM hashids_precompute_shuffles_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    const ehashids_shuffles_t *shuffles;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    shuffles = ehashids_precompute_shuffles(ctx);
+    if(EHASHIDS_UNLIKELY(shuffles == NULL)) return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), enif_make_uint64(env, (ErlNifUInt64)shuffles->bytes));
+}
+
+static ERL_NIF_TERM hashids_enable_decode_cache_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    const ehashids_decode_cache_t *cache;
+    unsigned int entries;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    if(EHASHIDS_UNLIKELY(!enif_get_uint(env, argv[1], &entries) || entries == 0 || entries > EHASHIDS_DECODE_CACHE_MAX)){
+        return make_error_tuple_from_string(env, "entries");
+    }
+
+    cache = ehashids_enable_decode_cache(ctx, entries);
+    if(EHASHIDS_UNLIKELY(cache == NULL)) return ehashids_error(env, EHASHIDS_ATOM_ALLOC);
+
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_OK), enif_make_uint64(env, (ErlNifUInt64)cache->bytes));
+}
+
+// Sums up the stripes of stats into a map of counter name to value
+static ERL_NIF_TERM ehashids_make_stats(ErlNifEnv *env, const ehashids_stats_t *stats)
+{
+    ERL_NIF_TERM keys[EHASHIDS_STAT_COUNT];
+    ERL_NIF_TERM values[EHASHIDS_STAT_COUNT];
+    ERL_NIF_TERM map;
+    uint64_t total;
+
+    for(int i = 0; i < EHASHIDS_STAT_COUNT; i++){
+        total = 0;
+        for(int stripe = 0; stripe < EHASHIDS_STATS_STRIPES; stripe++){
+            total += __atomic_load_n(&stats->stripes[stripe].counts[i], __ATOMIC_RELAXED);
+        }
+        keys[i] = make_atom(env, ehashids_stat_names[i]);
+        values[i] = enif_make_uint64(env, (ErlNifUInt64)total);
+    }
+
+    (void)enif_make_map_from_arrays(env, keys, values, EHASHIDS_STAT_COUNT, &map);
+    return map;
+}
+
+static ERL_NIF_TERM hashids_info_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    const ehashids_shuffles_t *shuffles;
+    const ehashids_decode_cache_t *cache;
+    ERL_NIF_TERM info;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    shuffles = __atomic_load_n(&ctx->shuffles, __ATOMIC_ACQUIRE);
+    cache = __atomic_load_n(&ctx->decode_cache, __ATOMIC_ACQUIRE);
+    (void)enif_make_map_put(
+        env,
+        ehashids_make_stats(env, ctx->stats),
+        make_atom(env, "shuffles"),
+        enif_make_uint64(env, (ErlNifUInt64)(shuffles ? shuffles->bytes : 0)),
+        &info
     );
+    (void)enif_make_map_put(
+        env,
+        info,
+        make_atom(env, "decode_cache"),
+        enif_make_uint64(env, (ErlNifUInt64)(cache ? cache->bytes : 0)),
+        &info
+    );
+
+    return info;
+}
+
+// The context resource plus the precomputed shuffles and the decode cache, all of it counted by erlang:memory/0
+static ERL_NIF_TERM hashids_memory_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    ehashids_t *ctx = NULL;
+    const ehashids_shuffles_t *shuffles;
+    const ehashids_decode_cache_t *cache;
+
+    if(EHASHIDS_UNLIKELY(!ehashids_get_context(env, argv[0], &ctx))) {
+        return ehashids_error(env, EHASHIDS_ATOM_BAD_RESOURCE);
+    }
+
+    shuffles = __atomic_load_n(&ctx->shuffles, __ATOMIC_ACQUIRE);
+    cache = __atomic_load_n(&ctx->decode_cache, __ATOMIC_ACQUIRE);
+    return enif_make_uint64(env, (ErlNifUInt64)(ctx->bytes + (shuffles ? shuffles->bytes : 0) + (cache ? cache->bytes : 0)));
+}
+
+static ERL_NIF_TERM hashids_stats_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    return ehashids_make_stats(env, &((ehashids_priv_t *)enif_priv_data(env))->shared->stats);
 }
 
 static ERL_NIF_TERM make_atom(ErlNifEnv* env, const char* atom)
@@ -669,7 +4315,7 @@ static ERL_NIF_TERM make_error_tuple_from_string(ErlNifEnv* env, const char *err
 
 static ERL_NIF_TERM make_error_tuple(ErlNifEnv* env, ERL_NIF_TERM error)
 {
-    return enif_make_tuple2(env, make_atom(env, "error"), error);
+    return enif_make_tuple2(env, ehashids_atom(env, EHASHIDS_ATOM_ERROR), error);
 }
 
-ERL_NIF_INIT(ehashids, nif_funcs, handle_load, NULL, handle_upgrade, NULL);
+ERL_NIF_INIT(ehashids, nif_funcs, handle_load, NULL, handle_upgrade, handle_unload);
@@ -13,21 +13,68 @@
     estimate_encoded_size/2,
     encode/2,
     encode_one/2,
+    encode_many/2,
+    encode_many_one/2,
+    encode_range/3,
+    encode_into/2,
+    encode_into/3,
     decode/2,
+    decode_many/2,
     decode_safe/2,
+    decode_one/2,
+    new_keyring/1,
+    decode_any/2,
+    is_valid/2,
+    precompute_shuffles/1,
+    enable_decode_cache/2,
+    transcode_chunk/4,
     compile/1,
-    from_compiled/1
+    from_compiled/1,
+    cache_info/0,
+    info/1,
+    memory/1,
+    stats/0,
+    emit_telemetry/0,
+    emit_telemetry/1
 ]).
 -on_load(init/0).
 
 -define(APPNAME, ehashids).
 -define(LIBNAME, ehashids).
+-define(DEFAULT_CACHE_SIZE, 256).
 
 
 -opaque hashids_ref() :: binary().
 -export_type([hashids_ref/0]).
--opaque compiled_hashids_ref() :: tuple().
+-opaque compiled_hashids_ref() :: binary().
 -export_type([compiled_hashids_ref/0]).
+-opaque keyring_ref() :: binary().
+-export_type([keyring_ref/0]).
+-type stats() :: #{encode := non_neg_integer(),
+                   decode := non_neg_integer(),
+                   invalid_hash := non_neg_integer(),
+                   unsafe := non_neg_integer(),
+                   error := non_neg_integer(),
+                   wide := non_neg_integer(),
+                   regrow := non_neg_integer(),
+                   bytes := non_neg_integer(),
+                   decode_cache_hit := non_neg_integer(),
+                   decode_cache_miss := non_neg_integer(),
+                   decode_cache_eviction := non_neg_integer()}.
+-type info() :: #{encode := non_neg_integer(),
+                  decode := non_neg_integer(),
+                  invalid_hash := non_neg_integer(),
+                  unsafe := non_neg_integer(),
+                  error := non_neg_integer(),
+                  wide := non_neg_integer(),
+                  regrow := non_neg_integer(),
+                  bytes := non_neg_integer(),
+                  decode_cache_hit := non_neg_integer(),
+                  decode_cache_miss := non_neg_integer(),
+                  decode_cache_eviction := non_neg_integer(),
+                  shuffles := non_neg_integer(),
+                  decode_cache := non_neg_integer()}.
+-export_type([stats/0, info/0]).
 
 %% @doc Returns the default hashids alphabet.
 %% @end
@@ -55,11 +102,12 @@ min_alphabet_length() -> 16.
 min_hash_length() -> 0.
 
 %% @doc Creates a new hashids context. With the default parameters.
-%% <p>IMPORTANT do not share these references between processes.
-%% This can cause stability issues. Avoiding the shuffle overhead
-%% at initialization can be accomplished by caching the compiled
-%% output of the reference using the `compile/1' function and then
-%% recreating the reference in each process.
+%% <p>The reference is immutable and safe to share between processes,
+%% for example by keeping it in `persistent_term'. Contexts are cached
+%% by their parameters so repeated calls return the same reference,
+%% see `cache_info/0'. Avoiding the shuffle overhead at initialization
+%% can also be accomplished by caching the compiled output of the
+%% reference using the `compile/1' function.
 %% </p>
 %% @end
 -spec new() -> hashids_ref().
@@ -68,11 +116,10 @@ new() ->
 
 %% @doc Creates a new hashids context. With the default parameters
 %% but specify a custom salt.
-%% <p>IMPORTANT do not share these references between processes.
-%% This can cause stability issues. Avoiding the shuffle overhead
-%% at initialization can be accomplished by caching the compiled
-%% output of the reference using the `compile/1' function and then
-%% recreating the reference in each process.
+%% <p>The reference is immutable and safe to share between processes,
+%% for example by keeping it in `persistent_term'. Contexts are cached
+%% by their parameters so repeated calls return the same reference,
+%% see `cache_info/0'.
 %% </p>
 %% @end
 -spec new(Salt :: binary()) -> hashids_ref() | {error, Reason :: atom()}.
@@ -81,11 +128,10 @@ new(_Salt) ->
 
 %% @doc Creates a new hashids context. With the default parameters
 %% but specify a custom salt and minimum hash length.
-%% <p>IMPORTANT do not share these references between processes.
-%% This can cause stability issues. Avoiding the shuffle overhead
-%% at initialization can be accomplished by caching the compiled
-%% output of the reference using the `compile/1' function and then
-%% recreating the reference in each process.
+%% <p>The reference is immutable and safe to share between processes,
+%% for example by keeping it in `persistent_term'. Contexts are cached
+%% by their parameters so repeated calls return the same reference,
+%% see `cache_info/0'.
 %% </p>
 %% @end
 -spec new(Salt :: binary(), MinHashLen :: non_neg_integer()) -> hashids_ref() | {error, Reason :: atom()}.
@@ -99,12 +145,23 @@ new(_Salt, _MinHashLen) ->
 %% character set. If this a problem consider adding UTF-8 support
 %% to the underlying library.
 %% </p>
-%% <p>IMPORTANT do not share these references between processes.
-%% This can cause stability issues. Avoiding the shuffle overhead
-%% at initialization can be accomplished by caching the compiled
-%% output of the reference using the `compile/1' function and then
-%% recreating the reference in each process.
+%% <p>The reference is immutable and safe to share between processes,
+%% for example by keeping it in `persistent_term'. Contexts are cached
+%% by their parameters so repeated calls return the same reference,
+%% see `cache_info/0'.
 %% </p>
+%% <p>The error reasons are:
+%% </p>
+%% <ul>
+%%   <li>`salt', `min_hash_length' or `alphabet' when that argument has
+%%       the wrong type.</li>
+%%   <li>`alphabet_length' when the alphabet has fewer than
+%%       `min_alphabet_length/0' distinct characters. Like in the
+%%       underlying library it ends at the first zero byte.</li>
+%%   <li>`alphabet_space' when the alphabet contains a space or a
+%%       tab.</li>
+%%   <li>`alloc' when memory runs out.</li>
+%% </ul>
 %% @end
 -spec new(Salt :: binary(), MinHashLen :: non_neg_integer(), Alphabet :: binary()) ->
     hashids_ref() | {error, Reason :: atom()}.
@@ -119,9 +176,13 @@ estimate_encoded_size(_Ref, _Numbers) ->
     not_loaded(?LINE).
 
 %% @doc Encode a list of numbers into a hash id.
-%% <p>`Numbers' here are 64 bit unsigned integers internally larger
-%% integers will cause an error. For larger values multiple numbers
-%% can be used instead.
+%% <p>`Numbers' can be any non negative integer up to 4096 bits, so
+%% UUIDs and other 128 bit values encode to a single short id. Ids of
+%% numbers below 2^64 are the same as produced by other hashids
+%% implementations.
+%% </p>
+%% <p>Ids longer than a few kilobytes are encoded on a dirty CPU
+%% scheduler so they do not hold up other processes.
 %% </p>
 %% @end
 -spec encode(Ref :: hashids_ref(), Numbers :: list(non_neg_integer())) -> {ok, Id :: binary()} | {error, atom()}.
@@ -129,45 +190,248 @@ encode(_Ref, _Numbers) ->
     not_loaded(?LINE).
 
 %% @doc Encode a number into a hash id.
-%% <p>`Number' here is a 64 bit unsigned integer internally larger
-%% values will cause an error. For larger values multiple numbers
-%% can be used instead using the `encode/2' function.
+%% <p>Same as `encode(Ref, [Number])' without building the list. 64 bit
+%% numbers take a dedicated path that does not allocate anything but the
+%% id, `Number' can still be any non negative integer up to 4096 bits.
 %% </p>
 %% @end
 -spec encode_one(Ref :: hashids_ref(), Number :: non_neg_integer()) -> {ok, Id :: binary()} | {error, atom()}.
-encode_one(Ref, Number) -> encode(Ref, [Number]).
+encode_one(_Ref, _Number) ->
+    not_loaded(?LINE).
+
+%% @doc Encode many lists of numbers into hash ids in a single call.
+%% <p>Ids are returned in the same order as the input lists. This is
+%% the batch equivalent of calling `encode/2' on each element and fails
+%% with the same errors. Large batches yield back to the scheduler
+%% between chunks of a few kilobytes of ids instead of blocking it, from
+%% the first list that `encode/2' would encode on a dirty CPU scheduler
+%% on the rest of the batch is encoded there.
+%% </p>
+%% @end
+-spec encode_many(Ref :: hashids_ref(), NumbersList :: list(list(non_neg_integer()))) ->
+    {ok, Ids :: list(binary())} | {error, atom()}.
+encode_many(_Ref, _NumbersList) ->
+    not_loaded(?LINE).
+
+%% @doc Encode many numbers into hash ids in a single call.
+%% <p>Each number becomes its own hash id, this is the batch equivalent
+%% of calling `encode_one/2' on each element and is scheduled the same
+%% way as `encode_many/2'.
+%% </p>
+%% @end
+-spec encode_many_one(Ref :: hashids_ref(), Numbers :: list(non_neg_integer())) ->
+    {ok, Ids :: list(binary())} | {error, atom()}.
+encode_many_one(_Ref, _Numbers) ->
+    not_loaded(?LINE).
+
+%% @doc Encode the `Count' numbers from `From' on, each into its own id.
+%% <p>Returns the same ids as `encode_many_one(Ref, lists:seq(From, From
+%% + Count - 1))' without building the list or shuffling the alphabet
+%% for every number: the lottery of an id of one number only depends on
+%% the number modulo 100, so the shuffles are done once per lottery for
+%% the whole range. The ids are sub-binaries of binaries shared by up to
+%% 256 of them, `binary:copy/1' the ones kept around for long. All
+%% numbers of the range must fit in 64 bits. Long ranges yield back to
+%% the scheduler between chunks of a few kilobytes instead of blocking
+%% it, ranges of ids that `encode_one/2' would encode on a dirty CPU
+%% scheduler are encoded there.
+%% </p>
+%% @end
+-spec encode_range(Ref :: hashids_ref(), From :: non_neg_integer(), Count :: non_neg_integer()) ->
+    {ok, Ids :: list(binary())} | {error, atom()}.
+encode_range(_Ref, _From, _Count) ->
+    not_loaded(?LINE).
+
+%% @doc Encode many items into a single binary.
+%% <p>Equivalent to `encode_into(Ref, Items, #{})', the ids are
+%% concatenated without separators.
+%% </p>
+%% @end
+-spec encode_into(Ref :: hashids_ref(), Items :: list(non_neg_integer() | list(non_neg_integer()))) ->
+    {ok, binary()} | {error, atom()}.
+encode_into(Ref, Items) ->
+    encode_into(Ref, Items, #{}).
+
+%% @doc Encode many items into a single binary, for building responses.
+%% <p>Each item is a number or a list of numbers and becomes one id,
+%% in order. All ids are written into one binary that is allocated
+%% once for the whole call instead of once per id. `Opts' may contain:
+%% </p>
+%% <ul>
+%%   <li>`separator', iodata written between two ids.</li>
+%%   <li>`quote', iodata written before and after every id.</li>
+%%   <li>`prefix' and `suffix', iodata written at the start and end.</li>
+%%   <li>`offsets', when `true' the position and length of every id
+%%       (without quotes) is returned as well, for use with
+%%       `binary:part/3'.</li>
+%% </ul>
+%% <p>For example `#{prefix => "[", suffix => "]", quote => "\"",
+%% separator => ","}' produces a JSON array of ids. Large outputs are
+%% built on a dirty CPU scheduler.
+%% </p>
+%% @end
+-spec encode_into(Ref :: hashids_ref(),
+                  Items :: list(non_neg_integer() | list(non_neg_integer())),
+                  Opts :: #{separator => iodata(),
+                            quote => iodata(),
+                            prefix => iodata(),
+                            suffix => iodata(),
+                            offsets => boolean()}) ->
+    {ok, binary()} |
+    {ok, binary(), list({Pos :: non_neg_integer(), Len :: pos_integer()})} |
+    {error, atom()}.
+encode_into(_Ref, _Items, _Opts) ->
+    not_loaded(?LINE).
 
 %% @doc Decode a hash id into a list of numbers.
 %% <p>Note that decode here is not safe the Id can contain additional
 %% invalid data. If this is a problem use the equivalent `decode_safe/2'
 %% function.
 %% </p>
+%% <p>Ids longer than a few kilobytes are decoded on a dirty CPU
+%% scheduler so they do not hold up other processes.
+%% </p>
 %% @end
 -spec decode(Ref :: hashids_ref(), Id :: binary()) -> {ok, Numbers :: list(non_neg_integer())} | {error, atom()}.
 decode(_Ref, _Id) ->
     not_loaded(?LINE).
 
+%% @doc Decode a hash id of a single number.
+%% <p>The counterpart of `encode_one/2', returns the number itself rather
+%% than a list. Ids holding more than one number fail with
+%% `{error, invalid_hash}'. Like `decode/2' the id is not checked to be
+%% the canonical encoding of the number.
+%% </p>
+%% @end
+-spec decode_one(Ref :: hashids_ref(), Id :: binary()) -> {ok, Number :: non_neg_integer()} | {error, atom()}.
+decode_one(_Ref, _Id) ->
+    not_loaded(?LINE).
+
+%% @doc Decode many hash ids in a single call.
+%% <p>Returns one result per id in the same order as the input. Each
+%% result is what `decode/2' would return for that id, so a malformed
+%% id does not fail the whole batch. Large batches yield back to the
+%% scheduler between chunks of a few kilobytes of ids instead of
+%% blocking it, from the first id that `decode/2' would decode on a
+%% dirty CPU scheduler on the rest of the batch is decoded there.
+%% </p>
+%% @end
+-spec decode_many(Ref :: hashids_ref(), Ids :: list(binary())) ->
+    list({ok, Numbers :: list(non_neg_integer())} | {error, atom()}) | {error, atom()}.
+decode_many(_Ref, _Ids) ->
+    not_loaded(?LINE).
+
 %% @doc Decode a hash id into a list of numbers in a safe way.
 %% <p>This function decodes and also checks if the result is
-%% commutative with `encode/2'.
+%% commutative with `encode/2'. The check is done natively in the
+%% same call, without building the intermediate encoded id.
 %% </p>
 %% @end
 -spec decode_safe(Ref :: hashids_ref(), Id :: binary()) ->
     {ok, Numbers :: list(non_neg_integer())} | {error, unsafe} | {error, atom()}.
-decode_safe(Ref, Id0) ->
-    case decode(Ref, Id0) of
-        {ok, Numbers} ->
-            {ok, Id1} = encode(Ref, Numbers),
-            case Id0 =:= Id1 of
-                true -> {ok, Numbers};
-                false -> {error, unsafe}
-            end;
-        Error -> Error
-    end.
+decode_safe(_Ref, _Id) ->
+    not_loaded(?LINE).
+
+%% @doc Creates a keyring of up to 64 contexts for `decode_any/2'.
+%% <p>The keyring keeps the contexts alive and is as immutable and
+%% shareable as they are. A typical use is rotating salts, with the
+%% current context first and the previous ones after it.
+%% </p>
+%% @end
+-spec new_keyring(Refs :: list(hashids_ref())) -> keyring_ref() | {error, atom()}.
+new_keyring(_Refs) ->
+    not_loaded(?LINE).
+
+%% @doc Decodes an id with the first context of a keyring that accepts it.
+%% <p>Every context is tried in order like `decode_safe/2', all in one
+%% call, and the 1-based position of the one that decoded the id is
+%% returned with the numbers. Contexts whose alphabet, separators and
+%% guards don't cover every character of the id are skipped without
+%% decoding. When no context accepts the id the error is `unsafe' if
+%% one of them could decode it and `invalid_hash' otherwise.
+%% </p>
+%% @end
+-spec decode_any(Keyring :: keyring_ref(), Id :: binary()) ->
+    {ok, Index :: pos_integer(), Numbers :: list(non_neg_integer())} | {error, atom()}.
+decode_any(_Keyring, _Id) ->
+    not_loaded(?LINE).
 
-%% @doc Encode the `hashids_ref()' data in to a tuple to be cached.
-%% <p>This data needs to be treated as opaque changing the values
-%% can be dangerous!
+%% @doc Checks whether an id could have been produced by the context.
+%% <p>Only the characters and the layout of the id are checked, the
+%% numbers are not decoded, so this is much cheaper than `decode/2'.
+%% An id for which this returns `false' always fails to decode with
+%% `{error, invalid_hash}', use `decode_safe/2' for a full check. The
+%% characters are checked 16 or 32 at a time on CPUs with SSSE3 or AVX2.
+%% </p>
+%% @end
+-spec is_valid(Ref :: hashids_ref(), Id :: binary()) -> boolean() | {error, atom()}.
+is_valid(_Ref, _Id) ->
+    not_loaded(?LINE).
+
+%% @doc Precomputes the first shuffle of the alphabet for every lottery
+%% character of a context.
+%% <p>Every number of an id shuffles the alphabet, the first shuffle only
+%% depends on the lottery character so it can be done once for all of
+%% them. Ids of a single number then need no shuffle at all and longer
+%% ids one less. The memory used is returned, it is bounded by
+%% `AlphabetLength * (AlphabetLength + 256)' bytes, about 13 KB for the
+%% default alphabet, and is freed with the context. Calling it again
+%% returns the existing shuffles. Setting the `precompute_shuffles'
+%% application environment variable to `true' before the module is
+%% loaded does this for every context created by `new/0..3' and
+%% `from_compiled/1'.
+%% </p>
+%% @end
+-spec precompute_shuffles(Ref :: hashids_ref()) -> {ok, Bytes :: pos_integer()} | {error, atom()}.
+precompute_shuffles(_Ref) ->
+    not_loaded(?LINE).
+
+%% @doc Gives a context a cache of decoded ids with room for about
+%% `Entries' of them.
+%% <p>`decode/2', `decode_safe/2', `decode_one/2', `decode_many/2' and
+%% `decode_any/2' then look ids of up to 36 bytes up there first and keep
+%% the ones holding one or two 64 bit numbers once decoded, along with
+%% whether `decode_safe/2' accepts them. A cached id costs a hash lookup
+%% instead of a decode. Once full, ids not looked up for a while make
+%% room for new ones.
+%% </p>
+%% <p>The cache is split in one part per group of scheduler threads so
+%% they don't wait on each other, an id decoded on several schedulers is
+%% kept in the part of each of them. `Entries' is for all the parts
+%% together, every entry takes 64 bytes. The memory used is returned and
+%% is freed with the context. Calling it again returns the existing
+%% cache, whatever `Entries' is. References returned from the cache of
+%% `new/0..3' share their decode cache too. `info/1' counts the hits,
+%% misses and evictions.
+%% </p>
+%% @end
+-spec enable_decode_cache(Ref :: hashids_ref(), Entries :: pos_integer()) -> {ok, Bytes :: pos_integer()} | {error, atom()}.
+enable_decode_cache(_Ref, _Entries) ->
+    not_loaded(?LINE).
+
+%% @doc Transcodes a chunk of delimiter separated tokens.
+%% <p>With `encode' every token is a decimal 64 bit number and is
+%% replaced by its id, with `decode' every token is an id of a single
+%% number and is replaced by the number in decimal, ids that
+%% `decode_safe/2' would reject are errors. Every output token is
+%% followed by `Delimiter', empty tokens are skipped and so is a carriage
+%% return before a `$\n' delimiter. The delimiter can't be a digit or a
+%% character of the alphabet. The whole chunk is done in one call on a
+%% dirty CPU scheduler and `{ok, Output, Items}' is returned, errors
+%% carry the byte offset of the failing token in `Chunk'. This is the
+%% building block of `ehashids_bulk:transcode/4', which cuts larger
+%% inputs into chunks.
+%% </p>
+%% @end
+-spec transcode_chunk(Ref :: hashids_ref(), Direction :: encode | decode, Chunk :: binary(), Delimiter :: byte()) ->
+    {ok, Output :: binary(), Items :: non_neg_integer()} | {error, {atom(), non_neg_integer()}} | {error, atom()}.
+transcode_chunk(_Ref, _Direction, _Chunk, _Delimiter) ->
+    not_loaded(?LINE).
+
+%% @doc Encode the `hashids_ref()' data in to a binary to be cached.
+%% <p>The binary is small, versioned and checksummed so it can be kept
+%% in ETS, `persistent_term' or on disk. It needs to be treated as
+%% opaque.
 %% </p>
 %% @end
 -spec compile(Ref :: hashids_ref()) -> {ok, compiled_hashids_ref()} | {error, atom()}.
@@ -175,14 +439,113 @@ compile(_Ref) ->
     not_loaded(?LINE).
 
 %% @doc Create a new `hashids_ref()' from cached data avoiding shuffling.
-%% <p>The compiled data needs to be treated as opaque changing the values
-%% can be dangerous! Only use an input produced by the `compile/1' function.
+%% <p>Only use an input produced by the `compile/1' function. Data from
+%% an unknown format version is rejected with `{error, version}' and
+%% corrupted data with `{error, checksum}' or `{error, badarg}'. The
+%% tuples produced by earlier versions of `compile/1' are still accepted.
 %% </p>
 %% @end
--spec from_compiled(CompiledData :: compiled_hashids_ref()) -> hashids_ref() | {error, atom()}.
+-spec from_compiled(CompiledData :: compiled_hashids_ref() | tuple()) -> hashids_ref() | {error, atom()}.
 from_compiled(_CompiledData) ->
     not_loaded(?LINE).
 
+%% @doc Returns the state of the context cache used by `new/0..3'.
+%% <p>The cache holds up to `capacity' contexts, set with the `cache_size'
+%% application environment variable before the module is loaded (`0'
+%% disables it). Least recently used entries are evicted once it is full.
+%% </p>
+%% @end
+-spec cache_info() -> #{size := non_neg_integer(),
+                        capacity := non_neg_integer(),
+                        hits := non_neg_integer(),
+                        misses := non_neg_integer(),
+                        evictions := non_neg_integer()}.
+cache_info() ->
+    not_loaded(?LINE).
+
+%% @doc Returns the usage counters of a context.
+%% <p>Counters start at zero when the context is created and are shared
+%% by every process using the same reference, including references
+%% returned from the cache by `new/0..3'. They are:
+%% </p>
+%% <ul>
+%%   <li>`encode', ids encoded.</li>
+%%   <li>`decode', ids decoded, successfully or not.</li>
+%%   <li>`invalid_hash' and `unsafe', decodes that failed with these
+%%       errors.</li>
+%%   <li>`error', encodes and decodes that failed for any other reason.</li>
+%%   <li>`wide', ids holding numbers wider than 64 bits.</li>
+%%   <li>`regrow', calls that needed more scratch space than the stack
+%%       provides.</li>
+%%   <li>`bytes', bytes allocated for ids and scratch space.</li>
+%%   <li>`decode_cache_hit' and `decode_cache_miss', decodes of ids short
+%%       enough for the decode cache that it had or did not have.</li>
+%%   <li>`decode_cache_eviction', decode cache entries given up for
+%%       another id.</li>
+%% </ul>
+%% <p>Counting is cheap enough to stay on, reads are not atomic across
+%% counters. `shuffles' is the memory used by `precompute_shuffles/1'
+%% and `decode_cache' the one used by `enable_decode_cache/2' in bytes,
+%% `0' when they were not made.
+%% </p>
+%% @end
+-spec info(Ref :: hashids_ref()) -> info() | {error, atom()}.
+info(_Ref) ->
+    not_loaded(?LINE).
+
+%% @doc Returns the memory used by a context in bytes.
+%% <p>A context is a single allocation holding its strings, lookup
+%% tables and counters, plus the shuffles of `precompute_shuffles/1'
+%% and the cache of `enable_decode_cache/2' when they were made. All of
+%% it is allocated through the VM and shows up in `erlang:memory/0',
+%% contexts under `binary', shuffles and decode caches under `system'.
+%% References returned from the cache share their memory.
+%% </p>
+%% @end
+-spec memory(Ref :: hashids_ref()) -> Bytes :: pos_integer() | {error, atom()}.
+memory(_Ref) ->
+    not_loaded(?LINE).
+
+%% @doc Returns the usage counters of all the contexts together.
+%% <p>See `info/1' for the counters. They start at zero when the module
+%% is loaded.
+%% </p>
+%% @end
+-spec stats() -> stats().
+stats() ->
+    not_loaded(?LINE).
+
+%% @doc Emits the `stats/0' counters as a `[ehashids, stats]' telemetry event.
+%% <p>Does nothing when the `telemetry' application is not available. It
+%% can be used as a `telemetry_poller' measurement.
+%% </p>
+%% @end
+-spec emit_telemetry() -> ok.
+emit_telemetry() ->
+    telemetry_execute([?APPNAME, stats], stats(), #{}).
+
+%% @doc Emits the `info/1' counters of a context as a
+%% `[ehashids, context, stats]' telemetry event.
+%% <p>The reference is passed in the event metadata as `ref'. Does
+%% nothing when the `telemetry' application is not available.
+%% </p>
+%% @end
+-spec emit_telemetry(Ref :: hashids_ref()) -> ok.
+emit_telemetry(Ref) ->
+    telemetry_execute([?APPNAME, context, stats], info(Ref), #{ref => Ref}).
+
+%% internal - telemetry is an optional dependency
+telemetry_execute(Event, Measurements, Metadata) when is_map(Measurements) ->
+    case erlang:function_exported(telemetry, execute, 3) orelse
+         (code:ensure_loaded(telemetry) =:= {module, telemetry}) of
+        true ->
+            telemetry:execute(Event, Measurements, Metadata);
+        false ->
+            ok
+    end;
+telemetry_execute(_Event, _Measurements, _Metadata) ->
+    ok.
+
 %% internal - loads the NIF .so file
 init() ->
     SoName = case code:priv_dir(?APPNAME) of
@@ -196,7 +559,8 @@ init() ->
         Dir ->
             filename:join(Dir, ?LIBNAME)
     end,
-    erlang:load_nif(SoName, 0).
+    erlang:load_nif(SoName, #{cache_size => application:get_env(?APPNAME, cache_size, ?DEFAULT_CACHE_SIZE),
+                              precompute_shuffles => application:get_env(?APPNAME, precompute_shuffles, false)}).
 
 %% internal - returns an error if the implementation is not loaded
 not_loaded(Line) ->
@@ -0,0 +1,280 @@
+-module(ehashids_bulk).
+
+%% Bulk transcoding of delimiter separated numbers to hash ids and back.
+%%
+%% The input is cut into chunks ending on a delimiter. Every chunk is
+%% transcoded by `ehashids:transcode_chunk/4' on a dirty CPU scheduler,
+%% with up to `workers' chunks in flight at once, and the outputs are
+%% written in input order.
+
+-include_lib("kernel/include/file.hrl").
+
+-export([
+    transcode/4
+]).
+
+-define(DEFAULT_CHUNK_SIZE, 1048576).
+-define(DEFAULT_DELIMITER, $\n).
+
+-type direction() :: encode | decode.
+-type input() :: binary() | {file, file:name_all()}.
+-type progress() :: #{bytes := non_neg_integer(),
+                      total := non_neg_integer() | undefined,
+                      items := non_neg_integer()}.
+-type opts() :: #{delimiter => byte(),
+                  chunk_size => pos_integer(),
+                  workers => pos_integer(),
+                  output => binary | {file, file:name_all()},
+                  progress => fun((progress()) -> any())}.
+-export_type([direction/0, input/0, progress/0, opts/0]).
+
+%% @doc Transcodes every token of `Input' with the context `Ref'.
+%% <p>With `encode' the tokens are decimal 64 bit numbers and each one
+%% becomes the id `ehashids:encode_one/2' would return. With `decode'
+%% the tokens are ids of a single number and each one becomes that
+%% number in decimal, ids that `ehashids:decode_safe/2' would reject are
+%% errors. Every output token is followed by the delimiter, empty tokens
+%% are skipped and so are carriage returns ending a line.
+%% </p>
+%% <p>`Input' is a binary or `{file, Path}' which is read `chunk_size'
+%% bytes at a time. Options are:
+%% </p>
+%% <ul>
+%%   <li>`delimiter', the byte between tokens, `$\n' by default.</li>
+%%   <li>`chunk_size', bytes transcoded per call, 1 MB by default.</li>
+%%   <li>`workers', chunks transcoded in parallel, the number of dirty
+%%       CPU schedulers by default.</li>
+%%   <li>`output', `binary' (the default) returns the output as a list of
+%%       binaries to be used as iodata, `{file, Path}' writes it to a
+%%       file instead.</li>
+%%   <li>`progress', called in the caller after every chunk with the
+%%       input bytes and items done so far and the total input size
+%%       (`undefined' when it is unknown).</li>
+%% </ul>
+%% <p>Errors carry the byte offset in the input of the token that
+%% failed, for example `{error, {invalid_hash, 1042}}'.
+%% </p>
+%% @end
+-spec transcode(Ref :: ehashids:hashids_ref(), Direction :: direction(), Input :: input(), Opts :: opts()) ->
+    {ok, #{items := non_neg_integer(), output => [binary()]}} | {error, term()}.
+transcode(Ref, Direction, Input, Opts) ->
+    Delimiter = maps:get(delimiter, Opts, ?DEFAULT_DELIMITER),
+    ChunkSize = maps:get(chunk_size, Opts, ?DEFAULT_CHUNK_SIZE),
+    Workers = maps:get(workers, Opts, default_workers()),
+    Progress = maps:get(progress, Opts, fun(_) -> ok end),
+    case open_input(Input) of
+        {ok, Reader, Total} ->
+            try open_output(maps:get(output, Opts, binary)) of
+                {ok, Writer} ->
+                    State = #{ref => Ref,
+                              direction => Direction,
+                              delimiter => Delimiter,
+                              chunk_size => ChunkSize,
+                              workers => Workers,
+                              progress => Progress,
+                              total => Total,
+                              bytes => 0,
+                              items => 0},
+                    Result = run(Reader, Writer, State),
+                    close_output(Writer, Result);
+                {error, _} = Error ->
+                    Error
+            after
+                close_input(Reader)
+            end;
+        {error, _} = Error ->
+            Error
+    end.
+
+%% internal - the dirty schedulers do the work, or the normal ones without them
+default_workers() ->
+    try erlang:system_info(dirty_cpu_schedulers_online) of
+        N when N > 0 -> N;
+        _ -> erlang:system_info(schedulers_online)
+    catch
+        error:badarg -> erlang:system_info(schedulers_online)
+    end.
+
+%% internal - reads chunks, keeps up to workers of them in flight and writes the results in order
+run(Reader, Writer, State) ->
+    run(Reader, Writer, queue:new(), <<>>, 0, State).
+
+run(Reader, Writer, InFlight, Carry, Offset, #{workers := Workers} = State) ->
+    case queue:len(InFlight) >= Workers of
+        true ->
+            collect(Reader, Writer, InFlight, Carry, Offset, State);
+        false ->
+            case next_chunk(Reader, Carry, State) of
+                {ok, Chunk, Carry1, Reader1} ->
+                    Job = start(Chunk, Offset, State),
+                    run(Reader1, Writer, queue:in(Job, InFlight), Carry1, Offset + byte_size(Chunk), State);
+                eof ->
+                    drain(Writer, InFlight, State);
+                {error, _} = Error ->
+                    abort(InFlight),
+                    Error
+            end
+    end.
+
+collect(Reader, Writer, InFlight, Carry, Offset, State) ->
+    {{value, Job}, InFlight1} = queue:out(InFlight),
+    case finish(Job, Writer, State) of
+        {ok, Writer1, State1} ->
+            run(Reader, Writer1, InFlight1, Carry, Offset, State1);
+        {error, _} = Error ->
+            abort(InFlight1),
+            Error
+    end.
+
+drain(Writer, InFlight, State) ->
+    case queue:out(InFlight) of
+        {empty, _} ->
+            {ok, Writer, State};
+        {{value, Job}, InFlight1} ->
+            case finish(Job, Writer, State) of
+                {ok, Writer1, State1} ->
+                    drain(Writer1, InFlight1, State1);
+                {error, _} = Error ->
+                    abort(InFlight1),
+                    Error
+            end
+    end.
+
+%% internal - a job is a process transcoding one chunk and exiting with the result
+start(Chunk, Offset, #{ref := Ref, direction := Direction, delimiter := Delimiter}) ->
+    {Pid, MRef} = spawn_monitor(fun() ->
+                                    exit({transcoded, ehashids:transcode_chunk(Ref, Direction, Chunk, Delimiter)})
+                                end),
+    {Pid, MRef, Offset, byte_size(Chunk)}.
+
+finish({_Pid, MRef, Offset, Size}, Writer, #{bytes := Bytes, items := Items} = State) ->
+    receive
+        {'DOWN', MRef, process, _, {transcoded, {ok, Output, Count}}} ->
+            case write_output(Writer, Output) of
+                {ok, Writer1} ->
+                    State1 = State#{bytes := Bytes + Size, items := Items + Count},
+                    report(State1),
+                    {ok, Writer1, State1};
+                {error, _} = Error ->
+                    Error
+            end;
+        {'DOWN', MRef, process, _, {transcoded, {error, {Reason, Position}}}} when is_integer(Position) ->
+            {error, {Reason, Offset + Position}};
+        {'DOWN', MRef, process, _, {transcoded, {error, _} = Error}} ->
+            Error;
+        {'DOWN', MRef, process, _, Reason} ->
+            {error, {worker, Reason}}
+    end.
+
+abort(InFlight) ->
+    lists:foreach(fun({Pid, MRef, _, _}) ->
+                          erlang:demonitor(MRef, [flush]),
+                          exit(Pid, kill)
+                  end,
+                  queue:to_list(InFlight)).
+
+report(#{progress := Progress, bytes := Bytes, total := Total, items := Items}) ->
+    _ = Progress(#{bytes => Bytes, total => Total, items => Items}),
+    ok.
+
+%% internal - input, chunks always end right after a delimiter except the last one
+open_input(Input) when is_binary(Input) ->
+    {ok, {binary, Input}, byte_size(Input)};
+open_input({file, Path}) ->
+    case file:open(Path, [read, raw, binary]) of
+        {ok, Fd} ->
+            Total = case file:read_file_info(Path) of
+                        {ok, #file_info{size = Size}} -> Size;
+                        _ -> undefined
+                    end,
+            {ok, {file, Fd}, Total};
+        {error, Reason} ->
+            {error, {input, Reason}}
+    end.
+
+close_input({file, Fd}) ->
+    _ = file:close(Fd),
+    ok;
+close_input(_) ->
+    ok.
+
+next_chunk({binary, <<>>}, <<>>, _State) ->
+    eof;
+next_chunk({binary, Data}, <<>>, #{chunk_size := ChunkSize, delimiter := Delimiter}) ->
+    case byte_size(Data) =< ChunkSize of
+        true ->
+            {ok, Data, <<>>, {binary, <<>>}};
+        false ->
+            Cut = split_point(Data, Delimiter, ChunkSize),
+            <<Chunk:Cut/binary, Rest/binary>> = Data,
+            {ok, Chunk, <<>>, {binary, Rest}}
+    end;
+next_chunk({file, Fd} = Reader, Carry, #{chunk_size := ChunkSize, delimiter := Delimiter} = State) ->
+    case file:read(Fd, ChunkSize) of
+        {ok, Data} ->
+            Buffer = <<Carry/binary, Data/binary>>,
+            case last_delimiter(Buffer, Delimiter, byte_size(Buffer) - 1) of
+                none ->
+                    %% a token longer than a chunk, keep reading
+                    next_chunk(Reader, Buffer, State);
+                Last ->
+                    <<Chunk:(Last + 1)/binary, Rest/binary>> = Buffer,
+                    {ok, Chunk, Rest, Reader}
+            end;
+        eof when Carry =:= <<>> ->
+            eof;
+        eof ->
+            {ok, Carry, <<>>, Reader};
+        {error, Reason} ->
+            {error, {input, Reason}}
+    end.
+
+%% the last delimiter before ChunkSize ends the chunk, or the first one after it
+split_point(Data, Delimiter, ChunkSize) ->
+    case last_delimiter(Data, Delimiter, ChunkSize - 1) of
+        none ->
+            case binary:match(Data, <<Delimiter>>, [{scope, {ChunkSize, byte_size(Data) - ChunkSize}}]) of
+                nomatch -> byte_size(Data);
+                {Position, 1} -> Position + 1
+            end;
+        Last ->
+            Last + 1
+    end.
+
+last_delimiter(_Data, _Delimiter, Position) when Position < 0 ->
+    none;
+last_delimiter(Data, Delimiter, Position) ->
+    case binary:at(Data, Position) of
+        Delimiter -> Position;
+        _ -> last_delimiter(Data, Delimiter, Position - 1)
+    end.
+
+%% internal - output, written in input order
+open_output(binary) ->
+    {ok, {binary, []}};
+open_output({file, Path}) ->
+    case file:open(Path, [write, raw, binary]) of
+        {ok, Fd} -> {ok, {file, Fd}};
+        {error, Reason} -> {error, {output, Reason}}
+    end.
+
+write_output({binary, Acc}, Output) ->
+    {ok, {binary, [Output | Acc]}};
+write_output({file, Fd} = Writer, Output) ->
+    case file:write(Fd, Output) of
+        ok -> {ok, Writer};
+        {error, Reason} -> {error, {output, Reason}}
+    end.
+
+close_output({binary, _}, {ok, {binary, Acc}, #{items := Items}}) ->
+    {ok, #{items => Items, output => lists:reverse(Acc)}};
+close_output({file, _}, {ok, {file, Fd}, #{items := Items}}) ->
+    case file:close(Fd) of
+        ok -> {ok, #{items => Items}};
+        {error, Reason} -> {error, {output, Reason}}
+    end;
+close_output({file, Fd}, {error, _} = Error) ->
+    _ = file:close(Fd),
+    Error;
+close_output(_Writer, {error, _} = Error) ->
+    Error.
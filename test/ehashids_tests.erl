@@ -9,7 +9,7 @@ init_test() ->
   ?assert(is_reference(R0)),
   ?assertNotEqual(ehashids:encode_one(R0, 12345), ehashids:encode_one(R1, 12345)),
   ?assertEqual(ehashids:encode_one(R1, 12345), ehashids:encode_one(R2, 12345)),
-  ?assertNotEqual(R1, R2).
+  ?assertEqual(R1, R2).
 
 
 alphabet_test() ->
@@ -22,12 +22,128 @@ min_length_test() ->
   ?assertEqual(22, byte_size(element(2, ehashids:encode_one(R, 1)))).
 
 
+cache_test() ->
+  Salt = integer_to_binary(erlang:unique_integer()),
+  #{hits := Hits, misses := Misses} = ehashids:cache_info(),
+  R0 = ehashids:new(Salt, 5),
+  R1 = ehashids:new(Salt, 5),
+  ?assertEqual(R0, R1),
+  ?assertNotEqual(R0, ehashids:new(Salt, 6)),
+  #{hits := Hits1, misses := Misses1, size := Size, capacity := Capacity} = ehashids:cache_info(),
+  ?assert(Hits1 >= Hits + 1),
+  ?assert(Misses1 >= Misses + 2),
+  ?assert(Size =< Capacity),
+  ?assertEqual({error, alphabet_length}, ehashids:new(Salt, 0, <<"abc">>)).
+
+new_error_test() ->
+  Spaced = <<"abcdefghijklmnop ">>,
+  Short = <<"abcdefghijklmnoa">>,
+  %% the reasons don't depend on what other schedulers are doing
+  Parent = self(),
+  Pids = [spawn_link(fun() ->
+                         Results = [{ehashids:new(<<"s">>, 0, Spaced), ehashids:new(<<"s">>, 0, Short)}
+                                    || _ <- lists:seq(1, 500)],
+                         Parent ! {self(), lists:usort(Results)}
+                     end) || _ <- lists:seq(1, 8)],
+  [receive
+     {Pid, Results} ->
+       ?assertEqual([{{error, alphabet_space}, {error, alphabet_length}}], Results)
+   end || Pid <- Pids],
+  ?assertEqual({error, alphabet_length}, ehashids:new(<<"s">>, 0, <<"abcdefghijklmno", 0, "pqrstuvwxyz">>)),
+  ?assertEqual({error, salt}, ehashids:new(salt)),
+  ?assertEqual({error, min_hash_length}, ehashids:new(<<"s">>, -1)),
+  ?assertEqual({error, alphabet}, ehashids:new(<<"s">>, 0, "abcdefghijklmnopq")).
+
+upgrade_test() ->
+  Salt = integer_to_binary(erlang:unique_integer()),
+  R = ehashids:new(Salt),
+  {ok, Id} = ehashids:encode(R, [1, 2, 3]),
+  #{encode := Encodes} = ehashids:stats(),
+  %% reloading the module upgrades the library in place
+  _ = code:purge(ehashids),
+  {module, ehashids} = code:load_file(ehashids),
+  ?assertEqual({ok, [1, 2, 3]}, ehashids:decode_safe(R, Id)),
+  ?assertEqual(R, ehashids:new(Salt)),
+  ?assert(maps:get(encode, ehashids:stats()) >= Encodes),
+  %% and the old library is unloaded without taking the shared state along
+  _ = code:purge(ehashids),
+  ?assertEqual({ok, Id}, ehashids:encode(R, [1, 2, 3])),
+  ?assertEqual(R, ehashids:new(Salt)).
+
+upgrade_without_cache_test() ->
+  Old = application:get_env(ehashids, cache_size),
+  application:set_env(ehashids, cache_size, 0),
+  try
+    reload(),
+    ?assertMatch(#{capacity := 0}, ehashids:cache_info()),
+    R = ehashids:new(<<"My Salt">>),
+    {ok, Id} = ehashids:encode(R, [1, 2, 3]),
+    %% the upgrade keeps the disabled cache, old references still work
+    {module, ehashids} = code:load_file(ehashids),
+    ?assertEqual({ok, [1, 2, 3]}, ehashids:decode_safe(R, Id)),
+    ?assertMatch(#{capacity := 0, size := 0}, ehashids:cache_info()),
+    _ = code:purge(ehashids),
+    ?assertEqual({ok, Id}, ehashids:encode(ehashids:new(<<"My Salt">>), [1, 2, 3])),
+    ?assertEqual({ok, [1, 2, 3]}, ehashids:decode(R, Id))
+  after
+    case Old of
+      undefined -> application:unset_env(ehashids, cache_size);
+      {ok, Size} -> application:set_env(ehashids, cache_size, Size)
+    end,
+    reload()
+  end.
+
+%% loads the module and its library from scratch, load_info included
+reload() ->
+  _ = code:purge(ehashids),
+  true = code:delete(ehashids),
+  _ = code:purge(ehashids),
+  {module, ehashids} = code:load_file(ehashids).
+
+info_test() ->
+  R = ehashids:new(integer_to_binary(erlang:unique_integer())),
+  #{encode := 0, decode := 0} = ehashids:info(R),
+  #{encode := Encodes, invalid_hash := Invalid} = ehashids:stats(),
+  {ok, Id} = ehashids:encode(R, [1, 2]),
+  {ok, _} = ehashids:encode_many_one(R, [1 bsl 64, 3]),
+  {ok, _} = ehashids:decode_safe(R, Id),
+  {error, invalid_hash} = ehashids:decode(R, <<"!">>),
+  {error, unsafe} = ehashids:decode_safe(R, <<Id/binary, (binary:last(Id))>>),
+  {error, numbers} = ehashids:encode(R, [-1]),
+  ?assertMatch(#{encode := 3, decode := 3, invalid_hash := 1, unsafe := 1, error := 1, wide := 1},
+               ehashids:info(R)),
+  #{encode := Encodes1, invalid_hash := Invalid1} = ehashids:stats(),
+  ?assert(Encodes1 >= Encodes + 3),
+  ?assert(Invalid1 >= Invalid + 1),
+  ?assertEqual(ok, ehashids:emit_telemetry(R)).
+
 compile_test() ->
   R0 = ehashids:new(<<"">>, 22),
   {ok, C} = ehashids:compile(R0),
   R1 = ehashids:from_compiled(C),
   ?assertEqual(22, byte_size(element(2, ehashids:encode_one(R1, 1)))).
 
+compiled_format_test() ->
+  R = ehashids:new(<<"mysalt">>, 10, <<"abcdefghijklmnop">>),
+  {ok, <<"EHID", 1, _/binary>> = C} = ehashids:compile(R),
+  Body = binary:part(C, 0, byte_size(C) - 4),
+  ?assertEqual(<<Body/binary, (erlang:crc32(Body)):32/little>>, C),
+  ?assertEqual({ok, C}, ehashids:compile(ehashids:from_compiled(C))),
+  <<Head:20/binary, First, Rest/binary>> = C,
+  ?assertEqual({error, checksum}, ehashids:from_compiled(<<Head/binary, (First bxor 1), Rest/binary>>)),
+  <<Magic:4/binary, _, Tail/binary>> = C,
+  ?assertEqual({error, version}, ehashids:from_compiled(<<Magic/binary, 2, Tail/binary>>)),
+  ?assertEqual({error, badarg}, ehashids:from_compiled(Body)),
+  ?assertEqual({error, badarg}, ehashids:from_compiled(<<>>)).
+
+compiled_legacy_test() ->
+  %% the tuple returned by compile/1 in earlier versions
+  C = {<<"bdegjklmnop", 0>>, <<"glpbknjedmo", 0>>, <<"mkdenjglopb", 0>>, 11,
+       <<0>>, 0, <<"cfhi", 0>>, 4, <<"a", 0>>, 1, 10},
+  R = ehashids:from_compiled(C),
+  ?assertEqual({ok, [12345]}, ehashids:decode_safe(R, <<"moadpemeag">>)),
+  ?assertEqual({error, badarg}, ehashids:from_compiled(setelement(4, C, 100))).
+
 decode_test() ->
   R0 = ehashids:new(),
   R1 = ehashids:new(),
@@ -50,4 +166,294 @@ salt_for_arity2_test() ->
   %% >>> h = hashids.Hashids(salt='abc', min_length=6)
   %% >>> h.encode(123)
   %% 'KpL6q4'
-  ?assertEqual({ok, <<"KpL6q4">>}, ehashids:encode_one(R, 123)).
\ No newline at end of file
+  ?assertEqual({ok, <<"KpL6q4">>}, ehashids:encode_one(R, 123)).
+
+shared_ref_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  Self = self(),
+  Numbers = lists:seq(1, 1000),
+  Pids = [spawn_link(fun() ->
+                       Results = [begin
+                                    {ok, Id} = ehashids:encode_one(R, N),
+                                    ehashids:decode_safe(R, Id)
+                                  end || N <- Numbers],
+                       Self ! {self(), Results}
+                     end) || _ <- lists:seq(1, 16)],
+  Expected = [{ok, [N]} || N <- Numbers],
+  [receive {Pid, Results} -> ?assertEqual(Expected, Results) end || Pid <- Pids].
+
+encode_one_test() ->
+  R = ehashids:new(<<"My Salt">>, 8),
+  Numbers = [0, 1, 99, 100, 12345, 1 bsl 32, 1 bsl 64 - 1, 1 bsl 64, 1 bsl 200],
+  [begin
+     {ok, Id} = ehashids:encode(R, [N]),
+     ?assertEqual({ok, Id}, ehashids:encode_one(R, N)),
+     ?assertEqual({ok, N}, ehashids:decode_one(R, Id))
+   end || N <- Numbers],
+  {ok, Two} = ehashids:encode(R, [1, 2]),
+  ?assertEqual({error, invalid_hash}, ehashids:decode_one(R, Two)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode_one(R, <<"!">>)),
+  ?assertEqual({error, id}, ehashids:decode_one(R, 1)),
+  ?assertEqual({error, numbers}, ehashids:encode_one(R, -1)),
+  ?assertEqual({error, numbers}, ehashids:encode_one(R, <<"1">>)).
+
+encode_many_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  NumbersList = [[N, N * 2] || N <- lists:seq(1, 5000)],
+  Expected = [element(2, ehashids:encode(R, Numbers)) || Numbers <- NumbersList],
+  ?assertEqual({ok, Expected}, ehashids:encode_many(R, NumbersList)),
+  ?assertEqual({ok, []}, ehashids:encode_many(R, [])),
+  ?assertEqual({error, numbers}, ehashids:encode_many(R, [[1], [-1]])).
+
+encode_many_one_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  Numbers = lists:seq(1, 5000),
+  Expected = [element(2, ehashids:encode_one(R, N)) || N <- Numbers],
+  ?assertEqual({ok, Expected}, ehashids:encode_many_one(R, Numbers)),
+  ?assertEqual({error, numbers}, ehashids:encode_many_one(R, [1 | 2])).
+
+encode_into_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  Items = [1, [2, 3], 1 bsl 64 | lists:seq(4, 2000)],
+  Ids = [element(2, ehashids:encode(R, if is_list(I) -> I; true -> [I] end)) || I <- Items],
+  Json = iolist_to_binary(["[", lists:join(",", [["\"", Id, "\""] || Id <- Ids]), "]"]),
+  Opts = #{prefix => "[", suffix => <<"]">>, quote => "\"", separator => ","},
+  ?assertEqual({ok, Json}, ehashids:encode_into(R, Items, Opts)),
+  {ok, Json, Offsets} = ehashids:encode_into(R, Items, Opts#{offsets => true}),
+  ?assertEqual(Ids, [binary:part(Json, Pos, Len) || {Pos, Len} <- Offsets]),
+  ?assertEqual({ok, iolist_to_binary(Ids)}, ehashids:encode_into(R, Items)),
+  ?assertEqual({ok, <<"[]">>}, ehashids:encode_into(R, [], Opts)),
+  ?assertEqual({error, numbers}, ehashids:encode_into(R, [1, -1])),
+  ?assertEqual({error, options}, ehashids:encode_into(R, [1], #{quote => 1.0})).
+
+encode_into_bignum_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  Items = [1 bsl 4096 - N || N <- lists:seq(1, 50)] ++ [[1, 1 bsl 4095], 1 bsl 128],
+  Ids = [element(2, ehashids:encode(R, if is_list(I) -> I; true -> [I] end)) || I <- Items],
+  {ok, Joined, Offsets} = ehashids:encode_into(R, Items, #{separator => ",", offsets => true}),
+  ?assertEqual(iolist_to_binary(lists:join(",", Ids)), Joined),
+  ?assertEqual(Ids, [binary:part(Joined, Pos, Len) || {Pos, Len} <- Offsets]),
+  ?assertEqual({error, numbers}, ehashids:encode_into(R, [1 bsl 4096 - 1, 1 bsl 4096])).
+
+encode_range_test() ->
+  lists:foreach(fun({R, From, Count}) ->
+                    ?assertEqual(ehashids:encode_many_one(R, lists:seq(From, From + Count - 1)),
+                                 ehashids:encode_range(R, From, Count))
+                end,
+                [{ehashids:new(<<"My Salt">>), 0, 3000},
+                 {ehashids:new(<<"My Salt">>, 30), 1 bsl 40, 250},
+                 {ehashids:new(<<"">>, 500, <<"0123456789abcdef">>), 7, 120},
+                 %% past the padding kept per lottery, and on a dirty scheduler
+                 {ehashids:new(<<"My Salt">>, 10000), 42, 120},
+                 {ehashids:new(<<"My Salt">>, 8), (1 bsl 64) - 10, 10}]),
+  R = ehashids:new(<<"My Salt">>),
+  ?assertEqual({ok, [<<"Ao">>, <<"Kg">>]}, ehashids:encode_range(R, 1, 2)),
+  ?assertEqual({ok, []}, ehashids:encode_range(R, 5, 0)),
+  ?assertEqual({error, numbers}, ehashids:encode_range(R, (1 bsl 64) - 1, 2)),
+  ?assertEqual({error, numbers}, ehashids:encode_range(R, -1, 2)),
+  ?assertEqual({error, count}, ehashids:encode_range(R, 1, -1)),
+  ?assertEqual({error, bad_resource}, ehashids:encode_range(make_ref(), 1, 2)).
+
+precompute_shuffles_test() ->
+  R = ehashids:new(integer_to_binary(erlang:unique_integer()), 0, <<"0123456789abcdefghij">>),
+  Inputs = [[N] || N <- lists:seq(0, 500)] ++ [[N, N * 7, 1 bsl 70] || N <- lists:seq(0, 100)],
+  {ok, Ids} = ehashids:encode_many(R, Inputs),
+  ?assertMatch(#{shuffles := 0}, ehashids:info(R)),
+  {ok, Bytes} = ehashids:precompute_shuffles(R),
+  ?assert(Bytes > 0 andalso Bytes < 256 * (256 + 256)),
+  ?assertEqual({ok, Bytes}, ehashids:precompute_shuffles(R)),
+  ?assertMatch(#{shuffles := Bytes}, ehashids:info(R)),
+  ?assertEqual({ok, Ids}, ehashids:encode_many(R, Inputs)),
+  ?assertEqual([{ok, I} || I <- Inputs], [ehashids:decode_safe(R, Id) || Id <- Ids]).
+
+decode_cache_test() ->
+  R = ehashids:new(integer_to_binary(erlang:unique_integer()), 22),
+  {ok, <<_, Padding/binary>> = Id} = ehashids:encode_one(R, 1),
+  Tampered = <<"g", Padding/binary>>,
+  ?assertMatch(#{decode_cache := 0}, ehashids:info(R)),
+  Memory = ehashids:memory(R),
+  {ok, Bytes} = ehashids:enable_decode_cache(R, 1024),
+  ?assert(Bytes >= 1024 * 64),
+  ?assertEqual({ok, Bytes}, ehashids:enable_decode_cache(R, 16)),
+  ?assertEqual(Memory + Bytes, ehashids:memory(R)),
+  %% the first call misses, the later ones hit while they stay on the same scheduler
+  ?assertEqual(lists:duplicate(17, {ok, [1]}), [ehashids:decode_safe(R, Id) || _ <- lists:seq(1, 17)]),
+  ?assertEqual({ok, 1}, ehashids:decode_one(R, Id)),
+  ?assertEqual({ok, [1]}, ehashids:decode(R, Tampered)),
+  ?assertEqual({error, unsafe}, ehashids:decode_safe(R, Tampered)),
+  ?assertEqual({error, unsafe}, ehashids:decode_safe(R, Tampered)),
+  ?assertEqual({ok, [1]}, ehashids:decode(R, Tampered)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode(R, <<"!!!">>)),
+  #{decode_cache_hit := Hits, decode_cache_miss := Misses, decode_cache := Bytes} = ehashids:info(R),
+  ?assert(Hits >= 1),
+  ?assertEqual(23, Hits + Misses),
+  ?assertEqual({error, entries}, ehashids:enable_decode_cache(R, 0)),
+  ?assertEqual({error, bad_resource}, ehashids:enable_decode_cache(make_ref(), 16)).
+
+decode_cache_eviction_test() ->
+  R = ehashids:new(integer_to_binary(erlang:unique_integer())),
+  %% 16 entries leave every scheduler a single set, far fewer than the ids
+  {ok, _} = ehashids:enable_decode_cache(R, 16),
+  Numbers = lists:seq(1, 200),
+  {ok, Ids} = ehashids:encode_many_one(R, Numbers),
+  Expected = [{ok, [N]} || N <- Numbers],
+  ?assertEqual(Expected, [ehashids:decode(R, Id) || Id <- Ids]),
+  ?assertEqual(Expected, [ehashids:decode_safe(R, Id) || Id <- Ids]),
+  ?assertEqual([{ok, N} || N <- Numbers], [ehashids:decode_one(R, Id) || Id <- Ids]),
+  #{decode_cache_eviction := Evictions, decode_cache_miss := Misses} = ehashids:info(R),
+  ?assert(Evictions > 0),
+  ?assert(Misses >= 200).
+
+decode_many_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  {ok, Ids} = ehashids:encode_many(R, [[N, N + 1] || N <- lists:seq(1, 5000)]),
+  Expected = [{ok, [N, N + 1]} || N <- lists:seq(1, 5000)],
+  ?assertEqual(Expected, ehashids:decode_many(R, Ids)),
+  ?assertEqual([{ok, [1, 2]}, {error, invalid_hash}, {error, id}],
+               ehashids:decode_many(R, [hd(Ids), <<"!!!">>, not_an_id])),
+  ?assertEqual({error, ids}, ehashids:decode_many(R, [hd(Ids) | not_a_list])).
+
+decode_safe_test() ->
+  R = ehashids:new(<<"">>, 22),
+  {ok, <<_, Padding/binary>> = Id} = ehashids:encode_one(R, 1),
+  Tampered = <<"g", Padding/binary>>,
+  ?assertEqual({ok, [1]}, ehashids:decode_safe(R, Id)),
+  ?assertEqual({ok, [1]}, ehashids:decode(R, Tampered)),
+  ?assertEqual({error, unsafe}, ehashids:decode_safe(R, Tampered)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode_safe(R, <<"!!!">>)).
+
+decode_any_test() ->
+  Current = ehashids:new(<<"salt 3">>),
+  Previous = ehashids:new(<<"salt 2">>),
+  Other = ehashids:new(<<"salt 1">>, 0, <<"0123456789abcdef">>),
+  K = ehashids:new_keyring([Current, Previous, Other]),
+  {ok, Id3} = ehashids:encode(Current, [1, 2, 3]),
+  {ok, Id2} = ehashids:encode(Previous, [4, 5]),
+  {ok, Id1} = ehashids:encode(Other, [6]),
+  ?assertEqual({ok, 1, [1, 2, 3]}, ehashids:decode_any(K, Id3)),
+  ?assertEqual({ok, 2, [4, 5]}, ehashids:decode_any(K, Id2)),
+  ?assertEqual({ok, 3, [6]}, ehashids:decode_any(K, Id1)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode_any(K, <<"!!">>)),
+  ?assertEqual({error, unsafe}, ehashids:decode_any(K, <<Id3/binary, (binary:last(Id3))>>)),
+  ?assertEqual({error, keys}, ehashids:new_keyring([])),
+  ?assertEqual({error, bad_resource}, ehashids:new_keyring([Current, make_ref()])),
+  ?assertEqual({error, bad_resource}, ehashids:decode_any(Current, Id3)).
+
+decode_sub_binary_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  {ok, Id} = ehashids:encode(R, lists:seq(1, 100)),
+  Wrapped = <<"[", Id/binary, "]">>,
+  SubId = binary:part(Wrapped, 1, byte_size(Id)),
+  ?assertEqual({ok, lists:seq(1, 100)}, ehashids:decode(R, SubId)),
+  ?assertEqual({ok, lists:seq(1, 100)}, ehashids:decode_safe(R, SubId)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode(R, <<Id/binary, 0>>)).
+
+decode_invalid_character_test() ->
+  R = ehashids:new(<<"">>, 10, <<"1234567890abcdef">>),
+  ?assertEqual({ok, [12345]}, ehashids:decode(R, <<"a635945430">>)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode(R, <<"a63594543z">>)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode(R, <<"A635945430">>)),
+  ?assertEqual({error, invalid_hash}, ehashids:decode(R, <<"">>)).
+
+memory_test() ->
+  R = ehashids:new(integer_to_binary(erlang:unique_integer())),
+  Bytes = ehashids:memory(R),
+  ?assert(Bytes > 512 + byte_size(ehashids:default_alphabet())),
+  {ok, Shuffles} = ehashids:precompute_shuffles(R),
+  ?assertEqual(Bytes + Shuffles, ehashids:memory(R)),
+  ?assertEqual({error, bad_resource}, ehashids:memory(make_ref())).
+
+is_valid_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  {ok, Id} = ehashids:encode(R, lists:seq(1, 30)),
+  ?assert(ehashids:is_valid(R, Id)),
+  ?assertNot(ehashids:is_valid(R, <<>>)),
+  %% a bad byte anywhere in the vector chunks or the tail
+  [begin
+     <<Head:N/binary, _, Tail/binary>> = Id,
+     ?assertNot(ehashids:is_valid(R, <<Head/binary, Bad, Tail/binary>>)),
+     ?assertEqual({error, invalid_hash}, ehashids:decode(R, <<Head/binary, Bad, Tail/binary>>))
+   end || N <- lists:seq(0, byte_size(Id) - 1), Bad <- [$!, 0, 200]],
+  ?assertEqual({error, id}, ehashids:is_valid(R, not_an_id)).
+
+large_input_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  Numbers = lists:seq(1, 20000),
+  {ok, Id} = ehashids:encode(R, Numbers),
+  ?assert(byte_size(Id) > 4096),
+  ?assertEqual({ok, Numbers}, ehashids:decode(R, Id)),
+  ?assertEqual({ok, Numbers}, ehashids:decode_safe(R, Id)),
+  ?assertEqual({error, numbers}, ehashids:encode(R, [1 | lists:seq(-1, 20000)])),
+  Padded = ehashids:new(<<"My Salt">>, 10000),
+  {ok, PaddedId} = ehashids:encode(Padded, [1]),
+  ?assertEqual(10000, byte_size(PaddedId)),
+  ?assertEqual({ok, [1]}, ehashids:decode_safe(Padded, PaddedId)),
+  ?assertEqual({ok, [<<"Ao">>, Id, <<"Kg">>]}, ehashids:encode_many(R, [[1], Numbers, [2]])),
+  ?assertEqual([{ok, [1]}, {ok, Numbers}, {ok, [2]}], ehashids:decode_many(R, [<<"Ao">>, Id, <<"Kg">>])),
+  {ok, PaddedIds} = ehashids:encode_many_one(Padded, lists:seq(1, 5)),
+  ?assertEqual(PaddedId, hd(PaddedIds)),
+  ?assertEqual([{ok, [N]} || N <- lists:seq(1, 5)], ehashids:decode_many(Padded, PaddedIds)).
+
+bignum_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  ?assertEqual({ok, <<"pBldkJKxk87RB">>}, ehashids:encode_one(R, 1 bsl 64 - 1)),
+  ?assertEqual({ok, <<"8Lr28vlR8Nob3">>}, ehashids:encode_one(R, 1 bsl 64)),
+  ?assertEqual({ok, <<"MK0pPVgwJlEbjDLDjWklqbv0q">>}, ehashids:encode_one(R, 1 bsl 128 - 1)),
+  ?assertEqual({ok, <<"XGTEzA2XJP3yl4W0Po5OD2ie">>}, ehashids:encode(R, [1, 1 bsl 100, 3])),
+  ?assertEqual({ok, [1, 1 bsl 100, 3]}, ehashids:decode_safe(R, <<"XGTEzA2XJP3yl4W0Po5OD2ie">>)),
+  Big = 1 bsl 4096 - 1,
+  {ok, Id} = ehashids:encode(R, [Big, 7]),
+  ?assertEqual({ok, [Big, 7]}, ehashids:decode_safe(R, Id)),
+  {ok, BigId} = ehashids:encode_one(R, Big),
+  ?assertEqual({ok, [<<"Ao">>, Id, Id]}, ehashids:encode_many(R, [[1], [Big, 7], [Big, 7]])),
+  ?assertEqual({ok, [<<"Ao">>, BigId, BigId]}, ehashids:encode_many_one(R, [1, Big, Big])),
+  ?assertEqual({ok, [<<"8Lr28vlR8Nob3">>]}, ehashids:encode_many(R, [[1 bsl 64]])),
+  ?assertEqual({ok, [<<"8Lr28vlR8Nob3">>, <<"pBldkJKxk87RB">>]},
+               ehashids:encode_many_one(R, [1 bsl 64, 1 bsl 64 - 1])),
+  ?assertEqual({error, numbers}, ehashids:encode_one(R, 1 bsl 4096)),
+  ?assertEqual({error, numbers}, ehashids:encode_one(R, -(1 bsl 64))),
+  ?assertEqual({error, numbers}, ehashids:encode_one(R, 1.0e30)).
+
+bulk_transcode_test() ->
+  R = ehashids:new(<<"My Salt">>),
+  Numbers = lists:seq(1, 10000),
+  Input = iolist_to_binary([[integer_to_binary(N), $\n] || N <- Numbers]),
+  Ids = [begin {ok, Id} = ehashids:encode_one(R, N), Id end || N <- Numbers],
+  Expected = iolist_to_binary([[Id, $\n] || Id <- Ids]),
+  {ok, #{items := 10000, output := Output}} =
+    ehashids_bulk:transcode(R, encode, Input, #{chunk_size => 4096, workers => 4}),
+  ?assertEqual(Expected, iolist_to_binary(Output)),
+  {ok, #{items := 10000, output := Decoded}} =
+    ehashids_bulk:transcode(R, decode, Expected, #{chunk_size => 1000, workers => 3}),
+  ?assertEqual(Input, iolist_to_binary(Decoded)),
+  ?assertEqual({ok, <<"Ao,Kg,">>, 2}, ehashids:transcode_chunk(R, encode, <<"1,,2">>, $,)),
+  ?assertEqual({ok, <<"1\n2\n">>, 2}, ehashids:transcode_chunk(R, decode, <<"Ao\r\nKg">>, $\n)),
+  ?assertEqual({error, delimiter}, ehashids:transcode_chunk(R, encode, <<"1">>, $a)),
+  %% offsets are relative to the whole input
+  Bad = <<Expected/binary, "NV!\n">>,
+  ?assertEqual({error, {invalid_hash, byte_size(Expected)}},
+               ehashids_bulk:transcode(R, decode, Bad, #{chunk_size => 1000})),
+  ?assertEqual({error, {numbers, 2}}, ehashids_bulk:transcode(R, encode, <<"1\n-2\n">>, #{})),
+  %% files are read chunk by chunk and the progress reaches the total
+  Path = filename:join(filename:basedir(user_cache, "ehashids_tests"), "bulk.txt"),
+  ok = filelib:ensure_dir(Path),
+  ok = file:write_file(Path, Input),
+  OutPath = Path ++ ".out",
+  Self = self(),
+  {ok, #{items := 10000}} =
+    ehashids_bulk:transcode(R, encode, {file, Path},
+                            #{chunk_size => 3000, output => {file, OutPath},
+                              progress => fun(P) -> Self ! {progress, P} end}),
+  ?assertEqual({ok, Expected}, file:read_file(OutPath)),
+  Size = byte_size(Input),
+  ?assertMatch([#{bytes := Size, total := Size, items := 10000} | _],
+               flush_progress([])),
+  ok = file:delete(Path),
+  ok = file:delete(OutPath).
+
+flush_progress(Acc) ->
+  receive
+    {progress, P} -> flush_progress([P | Acc])
+  after 0 ->
+    Acc
+  end.